@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cfloat>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*!
+ * Axis aligned bounding box
+ */
+struct AABB {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	/*!
+	 * Creates an empty box, growing it by any point makes it contain just that point
+	 */
+	AABB();
+	AABB(glm::vec3 min, glm::vec3 max);
+
+	/*!
+	 * Grows the box to contain a point
+	 * @param point: the point
+	 */
+	void grow(glm::vec3 point);
+
+	/*!
+	 * @return whether the box contains at least one point
+	 */
+	bool isEmpty() const;
+
+	glm::vec3 center() const;
+
+	/*!
+	 * @return half the size of the box along every axis
+	 */
+	glm::vec3 extent() const;
+
+	/*!
+	 * Computes the box of the transformed box
+	 * @param transformation: the transformation, e.g. a model matrix
+	 * @return the smallest axis aligned box around the transformed box
+	 */
+	AABB transform(const glm::mat4& transformation) const;
+
+	/*!
+	 * Computes the bounding box of points
+	 * @param points: the points, e.g. GeometryData::positions
+	 * @return the box
+	 */
+	static AABB fromPoints(const std::vector<glm::vec3>& points);
+};
+
+AABB::AABB()
+	: min(FLT_MAX), max(-FLT_MAX)
+{
+}
+
+AABB::AABB(glm::vec3 min, glm::vec3 max)
+	: min(min), max(max)
+{
+}
+
+void AABB::grow(glm::vec3 point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+bool AABB::isEmpty() const
+{
+	return min.x > max.x;
+}
+
+glm::vec3 AABB::center() const
+{
+	return (min + max) * 0.5f;
+}
+
+glm::vec3 AABB::extent() const
+{
+	return (max - min) * 0.5f;
+}
+
+AABB AABB::transform(const glm::mat4& transformation) const
+{
+	if (isEmpty()) return *this;
+
+	// the extent along each world axis is the sum of the absolute projections of the box axes
+	glm::vec3 center = glm::vec3(transformation * glm::vec4(this->center(), 1.0f));
+	glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(transformation[0])), glm::abs(glm::vec3(transformation[1])), glm::abs(glm::vec3(transformation[2])));
+	glm::vec3 extent = absolute * this->extent();
+	return AABB(center - extent, center + extent);
+}
+
+AABB AABB::fromPoints(const std::vector<glm::vec3>& points)
+{
+	AABB box;
+	for (const glm::vec3& point : points)
+		box.grow(point);
+	return box;
+}
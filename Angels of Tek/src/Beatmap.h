@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "MappedFile.h"
+
+/*!
+ * Binary beatmap format, all values little-endian and 4-byte aligned:
+ *
+ *   BeatmapHeader
+ *   BeatmapLane[laneCount]
+ *   per lane: BeatmapNote[noteCount], sorted by time
+ *   per lane: float[indexCount], time of every indexStride-th note of the lane
+ *
+ * The file is memory-mapped and the records are read in place, so opening a track costs the same no
+ * matter how long it is and only the pages around the runner are ever touched.
+ */
+static const char BEATMAP_MAGIC[4] = { 'A', 'O', 'T', 'B' };
+static const uint32_t BEATMAP_VERSION = 2;
+
+struct BeatmapHeader {
+	char magic[4];
+	uint32_t version;
+	float bpm;
+
+	/*!
+	 * Distance the runner moves per second, converts the times of the notes into positions on the track
+	 */
+	float speed;
+	uint32_t laneCount;
+	uint32_t indexStride;
+
+	/*!
+	 * Time at which the last note of the track ends
+	 */
+	float endTime;
+	uint32_t reserved;
+};
+
+struct BeatmapLane {
+	/*!
+	 * Byte offsets of the notes and the seek index of the lane from the start of the file
+	 */
+	uint32_t noteOffset;
+	uint32_t noteCount;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+
+	/*!
+	 * Length of the longest note of the lane, bounds how far back a note can reach into a query
+	 */
+	float longestNote;
+	uint32_t reserved;
+};
+
+struct BeatmapNote {
+	/*!
+	 * Time the note starts, in seconds from the start of the track
+	 */
+	float time;
+
+	/*!
+	 * Time the note lasts, in seconds
+	 */
+	float length;
+
+	uint8_t lane;
+	uint8_t type;
+	uint16_t reserved;
+};
+
+static_assert(sizeof(BeatmapHeader) == 32, "beatmap header has to be 32 bytes");
+static_assert(sizeof(BeatmapLane) == 24, "beatmap lane has to be 24 bytes");
+static_assert(sizeof(BeatmapNote) == 12, "beatmap note has to be 12 bytes");
+
+/*!
+ * Read-only view of a beatmap, either a mapped file or an image held in memory
+ */
+class Beatmap
+{
+protected:
+	MappedFile _file;
+	std::vector<char> _image;
+
+	const char* _data;
+	size_t _size;
+	const BeatmapHeader* _header;
+	const BeatmapLane* _lanes;
+
+	/*!
+	 * Checks that every table of the image lies within it, so the records can be read without further checks
+	 */
+	bool validate();
+
+	const BeatmapNote* notes(unsigned int lane) const;
+	const float* seekIndex(unsigned int lane) const;
+
+public:
+	/*!
+	 * Default number of notes between two entries of the seek index
+	 */
+	static const uint32_t DEFAULT_INDEX_STRIDE = 64;
+
+	/*!
+	 * Speed of the runner in units per second if a beatmap does not set its own
+	 */
+	static const float DEFAULT_SPEED;
+
+	Beatmap();
+
+	Beatmap(const Beatmap&) = delete;
+	Beatmap& operator=(const Beatmap&) = delete;
+
+	/*!
+	 * Maps a beatmap file
+	 * @param path: path of the .aotb file
+	 * @return whether the file is a valid beatmap of this version
+	 */
+	bool open(const char* path);
+
+	/*!
+	 * Uses a beatmap image created by encode()
+	 * @param image: the encoded beatmap
+	 * @return whether the image is a valid beatmap
+	 */
+	bool load(std::vector<char> image);
+
+	bool isOpen() const;
+	float bpm() const;
+	float speed() const;
+	float endTime() const;
+	unsigned int laneCount() const;
+	unsigned int noteCount(unsigned int lane) const;
+	float longestNote(unsigned int lane) const;
+	const BeatmapNote& note(unsigned int lane, unsigned int i) const;
+
+	/*!
+	 * Finds the first note of a lane that starts at or after a time
+	 * Binary search over the seek index first, then within the block of notes it points to,
+	 * so a lookup touches the small index and a single block of records
+	 * @param lane: the lane
+	 * @param time: the time in seconds
+	 * @return index of the note, noteCount(lane) if there is none
+	 */
+	unsigned int lowerBound(unsigned int lane, float time) const;
+
+	/*!
+	 * Encodes notes into the binary format
+	 * @param bpm: beats per minute of the track
+	 * @param speed: distance the runner moves per second
+	 * @param laneCount: number of lanes, the lane of every note has to be below it
+	 * @param notes: the notes in any order
+	 * @param indexStride: number of notes between two entries of the seek index
+	 * @return the image of the beatmap file
+	 */
+	static std::vector<char> encode(float bpm, float speed, unsigned int laneCount, std::vector<BeatmapNote> notes, uint32_t indexStride = DEFAULT_INDEX_STRIDE);
+};
+
+const float Beatmap::DEFAULT_SPEED = 4.0f;
+
+Beatmap::Beatmap()
+	: _data(nullptr), _size(0), _header(nullptr), _lanes(nullptr)
+{
+}
+
+bool Beatmap::open(const char* path)
+{
+	_image.clear();
+	if (!_file.open(path)) {
+		_data = nullptr;
+		return false;
+	}
+
+	_data = _file.data();
+	_size = _file.size();
+	if (!validate()) {
+		_file.close();
+		return false;
+	}
+	return true;
+}
+
+bool Beatmap::load(std::vector<char> image)
+{
+	_file.close();
+	_image = std::move(image);
+	_data = _image.data();
+	_size = _image.size();
+	if (!validate()) {
+		_image.clear();
+		return false;
+	}
+	return true;
+}
+
+bool Beatmap::validate()
+{
+	_header = nullptr;
+	_lanes = nullptr;
+
+	if (_data == nullptr || _size < sizeof(BeatmapHeader)) return false;
+
+	const BeatmapHeader* header = (const BeatmapHeader*)_data;
+	if (std::memcmp(header->magic, BEATMAP_MAGIC, sizeof(BEATMAP_MAGIC)) != 0 || header->version != BEATMAP_VERSION
+		|| header->indexStride == 0 || !(header->speed > 0.0f)
+		|| (uint64_t)header->laneCount * sizeof(BeatmapLane) > _size - sizeof(BeatmapHeader))
+		return false;
+
+	const BeatmapLane* lanes = (const BeatmapLane*)(_data + sizeof(BeatmapHeader));
+	for (uint32_t lane = 0; lane < header->laneCount; lane++) {
+		const BeatmapLane& table = lanes[lane];
+		uint64_t notesEnd = table.noteOffset + (uint64_t)table.noteCount * sizeof(BeatmapNote);
+		uint64_t indexEnd = table.indexOffset + (uint64_t)table.indexCount * sizeof(float);
+		uint64_t expectedIndex = (table.noteCount + (uint64_t)header->indexStride - 1) / header->indexStride;
+		if (notesEnd > _size || indexEnd > _size || table.indexCount != expectedIndex
+			|| table.noteOffset % 4 != 0 || table.indexOffset % 4 != 0)
+			return false;
+	}
+
+	_header = header;
+	_lanes = lanes;
+	return true;
+}
+
+bool Beatmap::isOpen() const
+{
+	return _header != nullptr;
+}
+
+float Beatmap::bpm() const
+{
+	return _header->bpm;
+}
+
+float Beatmap::speed() const
+{
+	return _header->speed;
+}
+
+float Beatmap::endTime() const
+{
+	return _header->endTime;
+}
+
+unsigned int Beatmap::laneCount() const
+{
+	return _header != nullptr ? _header->laneCount : 0;
+}
+
+unsigned int Beatmap::noteCount(unsigned int lane) const
+{
+	return _lanes[lane].noteCount;
+}
+
+float Beatmap::longestNote(unsigned int lane) const
+{
+	return _lanes[lane].longestNote;
+}
+
+const BeatmapNote* Beatmap::notes(unsigned int lane) const
+{
+	return (const BeatmapNote*)(_data + _lanes[lane].noteOffset);
+}
+
+const float* Beatmap::seekIndex(unsigned int lane) const
+{
+	return (const float*)(_data + _lanes[lane].indexOffset);
+}
+
+const BeatmapNote& Beatmap::note(unsigned int lane, unsigned int i) const
+{
+	return notes(lane)[i];
+}
+
+unsigned int Beatmap::lowerBound(unsigned int lane, float time) const
+{
+	const BeatmapLane& table = _lanes[lane];
+	if (table.noteCount == 0) return 0;
+
+	// the last index entry before the time marks the block the note is in
+	const float* index = seekIndex(lane);
+	const float* entry = std::lower_bound(index, index + table.indexCount, time);
+	if (entry == index) return 0;
+
+	uint32_t stride = _header->indexStride;
+	uint32_t begin = (uint32_t)(entry - index - 1) * stride;
+	uint32_t end = std::min(begin + stride, table.noteCount);
+
+	const BeatmapNote* laneNotes = notes(lane);
+	const BeatmapNote* found = std::lower_bound(laneNotes + begin, laneNotes + end, time,
+		[](const BeatmapNote& note, float t) { return note.time < t; });
+	return (unsigned int)(found - laneNotes);
+}
+
+std::vector<char> Beatmap::encode(float bpm, float speed, unsigned int laneCount, std::vector<BeatmapNote> notes, uint32_t indexStride)
+{
+	indexStride = std::max<uint32_t>(1, indexStride);
+	std::stable_sort(notes.begin(), notes.end(), [](const BeatmapNote& a, const BeatmapNote& b) {
+		return a.lane != b.lane ? a.lane < b.lane : a.time < b.time;
+	});
+
+	BeatmapHeader header = {};
+	std::memcpy(header.magic, BEATMAP_MAGIC, sizeof(BEATMAP_MAGIC));
+	header.version = BEATMAP_VERSION;
+	header.bpm = bpm;
+	header.speed = speed;
+	header.laneCount = laneCount;
+	header.indexStride = indexStride;
+
+	// lay out all note tables first, then all seek indices
+	std::vector<BeatmapLane> lanes(laneCount, BeatmapLane());
+	size_t offset = sizeof(BeatmapHeader) + laneCount * sizeof(BeatmapLane);
+	size_t first = 0;
+	for (unsigned int lane = 0; lane < laneCount; lane++) {
+		size_t last = first;
+		while (last < notes.size() && notes[last].lane == lane) {
+			lanes[lane].longestNote = std::max(lanes[lane].longestNote, notes[last].length);
+			header.endTime = std::max(header.endTime, notes[last].time + notes[last].length);
+			last++;
+		}
+		lanes[lane].noteOffset = (uint32_t)offset;
+		lanes[lane].noteCount = (uint32_t)(last - first);
+		lanes[lane].indexCount = (lanes[lane].noteCount + indexStride - 1) / indexStride;
+		offset += (last - first) * sizeof(BeatmapNote);
+		first = last;
+	}
+	// notes of lanes outside of the lane count are dropped
+	notes.resize(first);
+
+	for (unsigned int lane = 0; lane < laneCount; lane++) {
+		lanes[lane].indexOffset = (uint32_t)offset;
+		offset += lanes[lane].indexCount * sizeof(float);
+	}
+
+	std::vector<char> image(offset);
+	std::memcpy(image.data(), &header, sizeof(header));
+	if (laneCount > 0)
+		std::memcpy(image.data() + sizeof(header), lanes.data(), laneCount * sizeof(BeatmapLane));
+	if (!notes.empty())
+		std::memcpy(image.data() + lanes[0].noteOffset, notes.data(), notes.size() * sizeof(BeatmapNote));
+
+	for (unsigned int lane = 0; lane < laneCount; lane++) {
+		const BeatmapNote* laneNotes = notes.data() + (lanes[lane].noteOffset - lanes[0].noteOffset) / sizeof(BeatmapNote);
+		float* index = (float*)(image.data() + lanes[lane].indexOffset);
+		for (uint32_t i = 0; i < lanes[lane].indexCount; i++)
+			index[i] = laneNotes[i * indexStride].time;
+	}
+
+	return image;
+}
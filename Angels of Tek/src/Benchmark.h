@@ -0,0 +1,413 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Noise.h"
+#include "RenderStats.h"
+
+/*!
+ * A key press of the input script, replayed at the start of the given frame
+ */
+struct ScriptedKey {
+	unsigned int frame;
+	int key;
+};
+
+/*!
+ * Measurements of a single benchmark frame
+ */
+struct BenchmarkFrame {
+	double cpuMs;
+	double gpuMs;
+	unsigned int drawCalls;
+	unsigned int submitted;
+	unsigned int culled;
+	unsigned int stateCalls;
+	unsigned int skippedStateCalls;
+	float inputLatencyMs;
+};
+
+/*!
+ * Headless, scripted benchmark mode for the render loop
+ *
+ * Usage: "Angels of Tek.exe" --benchmark <script> <output.csv> [--frames <n>] [--egl]
+ *
+ * The window is created hidden, vsync is disabled and every frame advances the game by a fixed timestep,
+ * so two runs of the same script render exactly the same frames. Without a GPU the loop can run on Mesa's
+ * llvmpipe (LIBGL_ALWAYS_SOFTWARE=1, e.g. under Xvfb), --egl requests an EGL instead of a native context.
+ *
+ * The script has one key press per line, "<frame> <key>", e.g. "0 SPACE" or "120 A". Lines starting with # are ignored.
+ *
+ * "Angels of Tek.exe" --bench-noise [<points>] times the CPU terrain height function instead of the game:
+ * the scalar glm port against the SSE version on one thread and on the thread pool.
+ */
+class Benchmark
+{
+protected:
+	/*!
+	 * Number of timer queries in flight, results are read back with this many frames of latency to avoid stalls
+	 */
+	static const unsigned int QUERY_COUNT = 3;
+
+	bool _enabled;
+	bool _egl;
+	bool _noiseBenchmark;
+	unsigned int _noisePoints;
+	std::string _outputPath;
+	unsigned int _frameCount;
+	float _timestep;
+
+	std::vector<ScriptedKey> _script;
+	size_t _nextKey;
+
+	unsigned int _frame;
+	GLuint _queries[QUERY_COUNT];
+	std::chrono::high_resolution_clock::time_point _cpuStart;
+	std::vector<BenchmarkFrame> _frames;
+
+	bool loadScript(const char* path);
+	void collectQuery(unsigned int frame);
+	static int parseKey(const std::string& name);
+
+public:
+	/*!
+	 * Parses the command line, benchmark mode stays disabled if --benchmark is not given
+	 * @param argc: argument count of main()
+	 * @param argv: arguments of main()
+	 */
+	Benchmark(int argc, char** argv);
+
+	/*!
+	 * @return whether the game runs in benchmark mode
+	 */
+	bool enabled() const;
+
+	/*!
+	 * @return whether the noise benchmark was requested instead of the game
+	 */
+	bool noiseBenchmark() const;
+
+	/*!
+	 * Times the scalar and SIMD terrain height functions and checks that they agree, needs no GL context
+	 * @return exit code of the program
+	 */
+	int runNoiseBenchmark() const;
+
+	/*!
+	 * Sets the window hints for an invisible window, must be called before glfwCreateWindow
+	 */
+	void configureWindow() const;
+
+	/*!
+	 * Creates GPU timer queries and disables vsync, must be called once the GL context is current
+	 */
+	void init();
+
+	/*!
+	 * @return the fixed frame timestep in seconds
+	 */
+	float timestep() const;
+
+	/*!
+	 * @return the simulated time of the current frame in seconds
+	 */
+	float time() const;
+
+	/*!
+	 * Replays all scripted key presses of the current frame through the given key callback
+	 * @param window: the window passed to the callback
+	 * @param callback: the key callback that handles real key presses
+	 */
+	void replayInput(GLFWwindow* window, GLFWkeyfun callback);
+
+	/*!
+	 * Starts the CPU and GPU timers of a frame
+	 */
+	void beginFrame();
+
+	/*!
+	 * Stops the timers of the current frame, call before swapping buffers
+	 */
+	void endFrame();
+
+	/*!
+	 * @return whether all frames have been rendered
+	 */
+	bool finished() const;
+
+	/*!
+	 * Waits for outstanding GPU timings, deletes the queries and writes all frames to the output CSV
+	 * Call while the GL context still exists, the benchmark outlives glfwTerminate()
+	 */
+	void writeResults();
+};
+
+Benchmark::Benchmark(int argc, char** argv)
+	: _enabled(false), _egl(false), _noiseBenchmark(false), _noisePoints(1 << 20), _frameCount(0), _timestep(1.0f / 60.0f), _nextKey(0), _frame(0)
+{
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--benchmark") == 0 && i + 2 < argc) {
+			_enabled = loadScript(argv[i + 1]);
+			_outputPath = argv[i + 2];
+			i += 2;
+		}
+		else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			_frameCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--egl") == 0) {
+			_egl = true;
+		}
+		else if (std::strcmp(argv[i], "--bench-noise") == 0) {
+			_noiseBenchmark = true;
+			if (i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				_noisePoints = std::atoi(argv[++i]);
+		}
+	}
+
+	// run a few seconds past the last scripted key if no frame count is given
+	if (_frameCount == 0)
+		_frameCount = (_script.empty() ? 0 : _script.back().frame) + 600;
+
+	for (unsigned int i = 0; i < QUERY_COUNT; i++)
+		_queries[i] = 0;
+}
+
+bool Benchmark::loadScript(const char* path)
+{
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		std::cout << "ERROR::BENCHMARK::SCRIPT_NOT_FOUND " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream stream(line);
+		ScriptedKey event;
+		std::string keyName;
+		if (!(stream >> event.frame >> keyName)) continue;
+
+		event.key = parseKey(keyName);
+		if (event.key == GLFW_KEY_UNKNOWN) {
+			std::cout << "ERROR::BENCHMARK::UNKNOWN_KEY " << keyName << std::endl;
+			continue;
+		}
+		_script.push_back(event);
+	}
+
+	// keep the script sorted so it can be replayed with a single cursor
+	std::stable_sort(_script.begin(), _script.end(), [](const ScriptedKey& a, const ScriptedKey& b) { return a.frame < b.frame; });
+	return true;
+}
+
+int Benchmark::parseKey(const std::string& name)
+{
+	if (name.size() == 1 && name[0] >= 'A' && name[0] <= 'Z') return GLFW_KEY_A + (name[0] - 'A');
+	if (name == "SPACE") return GLFW_KEY_SPACE;
+	if (name == "LEFT") return GLFW_KEY_LEFT;
+	if (name == "RIGHT") return GLFW_KEY_RIGHT;
+	if (name == "UP") return GLFW_KEY_UP;
+	if (name == "DOWN") return GLFW_KEY_DOWN;
+	if (name == "ESCAPE") return GLFW_KEY_ESCAPE;
+	if (name == "LEFT_SHIFT") return GLFW_KEY_LEFT_SHIFT;
+	if (name == "RIGHT_BRACKET") return GLFW_KEY_RIGHT_BRACKET;
+	if (name == "SLASH") return GLFW_KEY_SLASH;
+	if (name == "PRINT_SCREEN") return GLFW_KEY_PRINT_SCREEN;
+	if (name == "F2") return GLFW_KEY_F2;
+	if (name == "F8") return GLFW_KEY_F8;
+	return GLFW_KEY_UNKNOWN;
+}
+
+bool Benchmark::enabled() const
+{
+	return _enabled;
+}
+
+bool Benchmark::noiseBenchmark() const
+{
+	return _noiseBenchmark;
+}
+
+int Benchmark::runNoiseBenchmark() const
+{
+	// a square grid around the start of the track
+	const int columns = (int)std::sqrt((double)_noisePoints);
+	const int rows = columns;
+	const float x0 = -50.0f, z0 = -500.0f, spacing = 0.25f, time = 12.3f;
+	const size_t count = (size_t)columns * rows;
+
+	std::vector<float> scalar(count), simd(count), pooled(count);
+	std::vector<float> x(count), z(count);
+	for (int row = 0; row < rows; row++) {
+		for (int col = 0; col < columns; col++) {
+			x[row * columns + col] = x0 + col * spacing;
+			z[row * columns + col] = z0 + row * spacing;
+		}
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+	auto elapsedMs = [](Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); };
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < count; i++)
+		scalar[i] = Noise::height(x[i], z[i], time);
+	double scalarMs = elapsedMs(start);
+
+	start = Clock::now();
+	Noise::heights(x.data(), z.data(), count, time, simd.data());
+	double simdMs = elapsedMs(start);
+
+	ThreadPool pool;
+	start = Clock::now();
+	Noise::heightGrid(pool, x0, z0, spacing, columns, rows, time, pooled.data());
+	double pooledMs = elapsedMs(start);
+
+	// heights are a smoothstep of fract(), points right at a step may differ by float rounding
+	unsigned int mismatches = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (std::abs(scalar[i] - simd[i]) > 1e-3f || std::abs(scalar[i] - pooled[i]) > 1e-3f)
+			mismatches++;
+	}
+
+	std::cout << "Noise benchmark: " << count << " points" << std::endl;
+	std::cout << "  scalar:            " << scalarMs << " ms" << std::endl;
+	std::cout << "  sse, 1 thread:     " << simdMs << " ms (" << scalarMs / simdMs << "x)" << std::endl;
+	std::cout << "  sse, " << pool.threadCount() << " threads:    " << pooledMs << " ms (" << scalarMs / pooledMs << "x)" << std::endl;
+	std::cout << "  mismatches > 1e-3: " << mismatches << std::endl;
+
+	return mismatches == 0 ? 0 : 1;
+}
+
+void Benchmark::configureWindow() const
+{
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	if (_egl)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+}
+
+void Benchmark::init()
+{
+	glfwSwapInterval(0);
+	glGenQueries(QUERY_COUNT, _queries);
+	_frames.reserve(_frameCount);
+
+	std::cout << "Benchmark: " << _frameCount << " frames, renderer " << glGetString(GL_RENDERER) << std::endl;
+}
+
+float Benchmark::timestep() const
+{
+	return _timestep;
+}
+
+float Benchmark::time() const
+{
+	return _frame * _timestep;
+}
+
+void Benchmark::replayInput(GLFWwindow* window, GLFWkeyfun callback)
+{
+	while (_nextKey < _script.size() && _script[_nextKey].frame <= _frame) {
+		callback(window, _script[_nextKey].key, 0, GLFW_PRESS, 0);
+		callback(window, _script[_nextKey].key, 0, GLFW_RELEASE, 0);
+		_nextKey++;
+	}
+}
+
+void Benchmark::beginFrame()
+{
+	// the query of this slot was issued QUERY_COUNT frames ago and is most likely done by now
+	if (_frame >= QUERY_COUNT)
+		collectQuery(_frame - QUERY_COUNT);
+
+	renderStats.reset();
+	_cpuStart = std::chrono::high_resolution_clock::now();
+	glBeginQuery(GL_TIME_ELAPSED, _queries[_frame % QUERY_COUNT]);
+}
+
+void Benchmark::endFrame()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	std::chrono::duration<double, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - _cpuStart;
+
+	BenchmarkFrame frame;
+	frame.cpuMs = cpuTime.count();
+	frame.gpuMs = -1.0;
+	frame.drawCalls = renderStats.drawCalls;
+	frame.submitted = renderStats.submitted;
+	frame.culled = renderStats.culled;
+	frame.stateCalls = renderStats.stateCalls;
+	frame.skippedStateCalls = renderStats.skippedStateCalls;
+	frame.inputLatencyMs = renderStats.inputLatencyMs;
+	_frames.push_back(frame);
+
+	_frame++;
+}
+
+void Benchmark::collectQuery(unsigned int frame)
+{
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(_queries[frame % QUERY_COUNT], GL_QUERY_RESULT, &elapsed);
+	_frames[frame].gpuMs = elapsed / 1000000.0;
+}
+
+bool Benchmark::finished() const
+{
+	return _frame >= _frameCount;
+}
+
+void Benchmark::writeResults()
+{
+	for (unsigned int i = _frame > QUERY_COUNT ? _frame - QUERY_COUNT : 0; i < _frame; i++)
+		collectQuery(i);
+	if (_queries[0] != 0) {
+		glDeleteQueries(QUERY_COUNT, _queries);
+		for (unsigned int i = 0; i < QUERY_COUNT; i++)
+			_queries[i] = 0;
+	}
+
+	std::ofstream csv(_outputPath);
+	if (!csv.is_open()) {
+		std::cout << "ERROR::BENCHMARK::CANNOT_WRITE " << _outputPath << std::endl;
+		return;
+	}
+
+	double cpuTotal = 0.0, gpuTotal = 0.0;
+	unsigned long long stateTotal = 0, skippedTotal = 0;
+	double latencyTotal = 0.0;
+	unsigned int latencyFrames = 0;
+	csv << "frame,cpu_ms,gpu_ms,draw_calls,submitted,culled,state_calls,skipped_state_calls,input_latency_ms" << std::endl;
+	for (size_t i = 0; i < _frames.size(); i++) {
+		const BenchmarkFrame& frame = _frames[i];
+		csv << i << "," << frame.cpuMs << "," << frame.gpuMs << "," << frame.drawCalls << "," << frame.submitted << "," << frame.culled
+			<< "," << frame.stateCalls << "," << frame.skippedStateCalls << "," << frame.inputLatencyMs << std::endl;
+		cpuTotal += frame.cpuMs;
+		gpuTotal += frame.gpuMs;
+		stateTotal += frame.stateCalls;
+		skippedTotal += frame.skippedStateCalls;
+		if (frame.inputLatencyMs >= 0.0f) {
+			latencyTotal += frame.inputLatencyMs;
+			latencyFrames++;
+		}
+	}
+
+	if (!_frames.empty()) {
+		std::cout << "Benchmark: avg cpu " << cpuTotal / _frames.size() << " ms, avg gpu " << gpuTotal / _frames.size()
+			<< " ms, avg state calls " << stateTotal / _frames.size() << " issued / " << skippedTotal / _frames.size()
+			<< " skipped, avg input latency " << (latencyFrames > 0 ? latencyTotal / latencyFrames : -1.0)
+			<< " ms, written to " << _outputPath << std::endl;
+	}
+}
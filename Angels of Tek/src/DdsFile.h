@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TextureCompression.h"
+
+/*!
+ * Block-compressed image with its mip chain
+ */
+struct DdsImage {
+	TextureCompression compression;
+	int width, height;
+
+	/*!
+	 * All levels one after another, starting with the largest
+	 */
+	std::vector<unsigned char> data;
+	std::vector<size_t> levelOffsets;
+};
+
+/*!
+ * Reads and writes DDS files with the DX10 extension header, limited to single 2D images in BC1, BC4 or BC5
+ * Other tools (texconv, RenderDoc, GIMP) open these files as they are, which helps when checking the cache
+ */
+class DdsFile
+{
+protected:
+	struct PixelFormat {
+		uint32_t size, flags, fourCC, rgbBitCount, rMask, gMask, bMask, aMask;
+	};
+
+	struct Header {
+		uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+		uint32_t reserved1[11];
+		PixelFormat pixelFormat;
+		uint32_t caps, caps2, caps3, caps4, reserved2;
+	};
+
+	struct HeaderDx10 {
+		uint32_t dxgiFormat, resourceDimension, miscFlag, arraySize, miscFlags2;
+	};
+
+	static const uint32_t MAGIC = 0x20534444; // "DDS "
+	static const uint32_t FOURCC_DX10 = 0x30315844; // "DX10"
+
+	static uint32_t dxgiFormat(TextureCompression compression);
+	static TextureCompression fromDxgiFormat(uint32_t format);
+
+public:
+	/*!
+	 * Writes an image, through a temporary file so concurrent writers of the same file never leave it half written
+	 * @return whether the file was written
+	 */
+	static bool write(const std::string& path, const DdsImage& image);
+
+	/*!
+	 * Reads an image and checks that the levels it announces are complete
+	 * @return whether the file is a valid image
+	 */
+	static bool read(const std::string& path, DdsImage& image);
+};
+
+uint32_t DdsFile::dxgiFormat(TextureCompression compression)
+{
+	switch (compression) {
+	case TextureCompression::BC1: return 71; // DXGI_FORMAT_BC1_UNORM
+	case TextureCompression::BC4: return 80; // DXGI_FORMAT_BC4_UNORM
+	case TextureCompression::BC5: return 83; // DXGI_FORMAT_BC5_UNORM
+	default: return 0;
+	}
+}
+
+TextureCompression DdsFile::fromDxgiFormat(uint32_t format)
+{
+	switch (format) {
+	case 71: return TextureCompression::BC1;
+	case 80: return TextureCompression::BC4;
+	case 83: return TextureCompression::BC5;
+	default: return TextureCompression::NONE;
+	}
+}
+
+bool DdsFile::write(const std::string& path, const DdsImage& image)
+{
+	Header header = {};
+	header.size = sizeof(Header);
+	header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+	header.height = image.height;
+	header.width = image.width;
+	header.pitchOrLinearSize = (uint32_t)BlockCompression::compressedSize(image.compression, image.width, image.height);
+	header.mipMapCount = (uint32_t)image.levelOffsets.size();
+	header.pixelFormat.size = sizeof(PixelFormat);
+	header.pixelFormat.flags = 0x4; // four cc
+	header.pixelFormat.fourCC = FOURCC_DX10;
+	header.caps = 0x8 | 0x1000 | 0x400000; // complex, texture, mip map
+
+	HeaderDx10 dx10 = {};
+	dx10.dxgiFormat = dxgiFormat(image.compression);
+	dx10.resourceDimension = 3; // 2D texture
+	dx10.arraySize = 1;
+
+	std::string temporary = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	{
+		uint32_t magic = MAGIC;
+		std::ofstream file(temporary, std::ios::binary);
+		file.write((const char*)&magic, sizeof(magic));
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)&dx10, sizeof(dx10));
+		file.write((const char*)image.data.data(), image.data.size());
+		if (!file) {
+			file.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+
+	// rename does not replace an existing file on every platform, in that case another writer was first
+	std::remove(path.c_str());
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool DdsFile::read(const std::string& path, DdsImage& image)
+{
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) return false;
+
+	std::streamoff size = file.tellg();
+	std::streamoff headerSize = sizeof(MAGIC) + sizeof(Header) + sizeof(HeaderDx10);
+	if (size < headerSize) return false;
+	file.seekg(0);
+
+	uint32_t magic;
+	Header header;
+	HeaderDx10 dx10;
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&header, sizeof(header));
+	file.read((char*)&dx10, sizeof(dx10));
+	if (!file || magic != MAGIC || header.size != sizeof(Header) || header.pixelFormat.fourCC != FOURCC_DX10
+		|| dx10.arraySize != 1 || header.width == 0 || header.height == 0 || header.mipMapCount == 0 || header.mipMapCount > 32)
+		return false;
+
+	image.compression = fromDxgiFormat(dx10.dxgiFormat);
+	if (image.compression == TextureCompression::NONE) return false;
+	image.width = header.width;
+	image.height = header.height;
+
+	size_t expected = 0;
+	image.levelOffsets.clear();
+	for (uint32_t level = 0; level < header.mipMapCount; level++) {
+		image.levelOffsets.push_back(expected);
+		expected += BlockCompression::compressedSize(image.compression, std::max(1, image.width >> level), std::max(1, image.height >> level));
+	}
+	if ((size_t)(size - headerSize) != expected) return false;
+
+	image.data.resize(expected);
+	file.read((char*)image.data.data(), expected);
+	return (bool)file;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+/*!
+ * Limits the number of frames the GPU has queued and measures the input-to-present latency of every frame
+ *
+ * Every frame ends with a fence and a timestamp query after the buffer swap. Before the next frame samples
+ * its input, wait() blocks until at most maxFramesInFlight - 1 frames are still queued, so input is sampled
+ * as late as possible instead of piling up frames in the driver. The timestamp of a finished frame tells when
+ * it was done on the GPU, the latency of a frame is the time from the oldest key press it shows to then.
+ */
+class FramePacer
+{
+protected:
+	/*!
+	 * Fence and timestamp of a frame the GPU may still be working on
+	 */
+	struct Frame {
+		GLsync fence;
+		GLuint query;
+
+		/*!
+		 * Time of the oldest key press the frame shows, negative if it shows none
+		 */
+		double inputTime;
+	};
+
+	std::vector<Frame> _frames;
+	unsigned int _frame;
+
+	/*!
+	 * Times of the key presses the simulation has not applied yet, in the order they were posted
+	 */
+	std::deque<double> _inputTimes;
+	unsigned int _appliedInput;
+
+	/*!
+	 * Difference between the CPU clock and the GPU timestamps in seconds
+	 */
+	double _gpuOffset;
+	float _latency;
+
+	/*!
+	 * Waits for a frame and measures its latency
+	 */
+	void complete(Frame& frame);
+
+public:
+	/*!
+	 * @param maxFramesInFlight: number of frames the GPU may have queued, 1 for the lowest latency
+	 */
+	explicit FramePacer(unsigned int maxFramesInFlight = 2);
+
+	FramePacer(const FramePacer&) = delete;
+	FramePacer& operator=(const FramePacer&) = delete;
+
+	/*!
+	 * Creates the queries, needs a current GL context
+	 */
+	void init();
+
+	/*!
+	 * Deletes the fences and queries, call before the GL context is destroyed, the pacer is a global that outlives it
+	 */
+	void release();
+
+	/*!
+	 * @return seconds on the clock the key presses are measured with
+	 */
+	static double now();
+
+	/*!
+	 * Records a key press, called from the key callback right when it is polled
+	 */
+	void input();
+
+	/*!
+	 * Blocks until the GPU is done with all but maxFramesInFlight - 1 frames, call right before polling input
+	 */
+	void wait();
+
+	/*!
+	 * Queues the fence and timestamp of a frame, call right after swapping buffers
+	 * @param appliedInput: number of key presses the simulation applied up to the state of the frame
+	 */
+	void endFrame(unsigned int appliedInput);
+
+	/*!
+	 * @return input-to-present latency in milliseconds of the frame the last wait() finished, -1 if it showed no key press
+	 */
+	float latency() const;
+};
+
+FramePacer::FramePacer(unsigned int maxFramesInFlight)
+	: _frames(maxFramesInFlight > 0 ? maxFramesInFlight : 1), _frame(0), _appliedInput(0), _gpuOffset(0.0), _latency(-1.0f)
+{
+	for (Frame& frame : _frames) {
+		frame.fence = 0;
+		frame.query = 0;
+		frame.inputTime = -1.0;
+	}
+}
+
+void FramePacer::init()
+{
+	for (Frame& frame : _frames)
+		glGenQueries(1, &frame.query);
+}
+
+void FramePacer::release()
+{
+	for (Frame& frame : _frames) {
+		if (frame.fence != 0)
+			glDeleteSync(frame.fence);
+		if (frame.query != 0)
+			glDeleteQueries(1, &frame.query);
+		frame.fence = 0;
+		frame.query = 0;
+	}
+}
+
+double FramePacer::now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void FramePacer::input()
+{
+	_inputTimes.push_back(now());
+}
+
+void FramePacer::complete(Frame& frame)
+{
+	// flush once, so the fence does not wait for commands that were never sent to the GPU
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (glClientWaitSync(frame.fence, flags, 100000000) == GL_TIMEOUT_EXPIRED)
+		flags = 0;
+	glDeleteSync(frame.fence);
+	frame.fence = 0;
+
+	_latency = -1.0f;
+	if (frame.inputTime < 0.0) return;
+
+	// the GPU clock has its own epoch, it is related to the CPU clock right when the result is read
+	GLint64 gpuNow = 0;
+	GLuint64 done = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	_gpuOffset = now() - gpuNow * 1e-9;
+	glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &done);
+	_latency = (float)((done * 1e-9 + _gpuOffset - frame.inputTime) * 1000.0);
+}
+
+void FramePacer::wait()
+{
+	// the slot of this frame holds the frame maxFramesInFlight frames ago
+	Frame& frame = _frames[_frame % _frames.size()];
+	if (frame.fence != 0)
+		complete(frame);
+	else
+		_latency = -1.0f;
+}
+
+void FramePacer::endFrame(unsigned int appliedInput)
+{
+	Frame& frame = _frames[_frame % _frames.size()];
+
+	// the oldest key press that reached the state of this frame, later ones count as shown by the same frame
+	frame.inputTime = -1.0;
+	for (; _appliedInput < appliedInput && !_inputTimes.empty(); _appliedInput++) {
+		if (frame.inputTime < 0.0)
+			frame.inputTime = _inputTimes.front();
+		_inputTimes.pop_front();
+	}
+
+	glQueryCounter(frame.query, GL_TIMESTAMP);
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_frame++;
+}
+
+float FramePacer::latency() const
+{
+	return _latency;
+}
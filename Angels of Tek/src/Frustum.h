@@ -0,0 +1,164 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.h"
+#include "RenderStats.h"
+
+/*!
+ * Many bounding boxes stored as center and extent, one array per component (structure of arrays),
+ * so four boxes can be loaded into the lanes of one SSE register
+ */
+struct BoundsSoA {
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+
+	void clear();
+	void push_back(const AABB& box);
+	size_t size() const;
+};
+
+/*!
+ * The six planes of a camera frustum, extracted from the view projection matrix
+ */
+class Frustum
+{
+protected:
+	/*!
+	 * Planes as (normal, distance), a point p is inside if dot(normal, p) + distance >= 0 for all planes
+	 */
+	glm::vec4 _planes[6];
+
+	/*!
+	 * Tests a box against all planes
+	 */
+	bool intersects(glm::vec3 center, glm::vec3 extent) const;
+
+public:
+	/*!
+	 * Frustum constructor
+	 * @param viewProjMatrix: projection matrix * view matrix of the camera
+	 */
+	explicit Frustum(const glm::mat4& viewProjMatrix);
+
+	/*!
+	 * Tests a single box, counts it as submitted or culled in the render stats
+	 * @param box: the box in world space
+	 * @return whether the box is at least partially inside the frustum
+	 */
+	bool test(const AABB& box) const;
+
+	/*!
+	 * Tests many boxes four at a time, counts them as submitted or culled in the render stats
+	 * @param boxes: the boxes in world space
+	 * @param visible: receives 1 for every box that is at least partially inside the frustum, else 0
+	 * @return the number of visible boxes
+	 */
+	size_t cull(const BoundsSoA& boxes, std::vector<unsigned char>& visible) const;
+};
+
+/* --------------------------------------------- */
+// Bounds SoA
+/* --------------------------------------------- */
+
+void BoundsSoA::clear()
+{
+	centerX.clear(); centerY.clear(); centerZ.clear();
+	extentX.clear(); extentY.clear(); extentZ.clear();
+}
+
+void BoundsSoA::push_back(const AABB& box)
+{
+	glm::vec3 center = box.center();
+	glm::vec3 extent = box.extent();
+	centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+	extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+}
+
+size_t BoundsSoA::size() const
+{
+	return centerX.size();
+}
+
+/* --------------------------------------------- */
+// Frustum
+/* --------------------------------------------- */
+
+Frustum::Frustum(const glm::mat4& viewProjMatrix)
+{
+	// rows of the matrix (glm is column major)
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(viewProjMatrix[0][i], viewProjMatrix[1][i], viewProjMatrix[2][i], viewProjMatrix[3][i]);
+
+	_planes[0] = row[3] + row[0]; // left
+	_planes[1] = row[3] - row[0]; // right
+	_planes[2] = row[3] + row[1]; // bottom
+	_planes[3] = row[3] - row[1]; // top
+	_planes[4] = row[3] + row[2]; // near
+	_planes[5] = row[3] - row[2]; // far
+}
+
+bool Frustum::intersects(glm::vec3 center, glm::vec3 extent) const
+{
+	for (const glm::vec4& plane : _planes) {
+		// the box is outside if even its corner furthest along the normal is behind the plane
+		glm::vec3 normal = glm::vec3(plane);
+		if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::test(const AABB& box) const
+{
+	bool visible = intersects(box.center(), box.extent());
+	if (visible)
+		renderStats.submitted++;
+	else
+		renderStats.culled++;
+	return visible;
+}
+
+size_t Frustum::cull(const BoundsSoA& boxes, std::vector<unsigned char>& visible) const
+{
+	size_t count = boxes.size();
+	visible.resize(count);
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 cx = _mm_loadu_ps(&boxes.centerX[i]), cy = _mm_loadu_ps(&boxes.centerY[i]), cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extentX[i]), ey = _mm_loadu_ps(&boxes.extentY[i]), ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		// each plane is broadcast and tested against four boxes, a lane stays set while its box is in front of all planes
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& plane : _planes) {
+			__m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(nx, absMask), ex), _mm_mul_ps(_mm_and_ps(ny, absMask), ey)), _mm_mul_ps(_mm_and_ps(nz, absMask), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+			visible[i + lane] = (mask >> lane) & 1;
+	}
+
+	for (; i < count; i++) {
+		glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+		glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+		visible[i] = intersects(center, extent) ? 1 : 0;
+	}
+
+	size_t visibleCount = 0;
+	for (unsigned char v : visible)
+		visibleCount += v;
+
+	renderStats.submitted += (unsigned int)visibleCount;
+	renderStats.culled += (unsigned int)(count - visibleCount);
+	return visibleCount;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLState.h"
+#include "RenderStats.h"
+
+/*!
+ * A single triangle that covers the whole screen, for passes that shade every pixel
+ * It has no vertex buffers: the vertex shader builds the corners from gl_VertexID (see sky.vert),
+ * the VAO only exists because the core profile does not allow drawing without one
+ */
+class FullscreenTriangle
+{
+protected:
+	/*!
+	 * Empty vertex array object
+	 */
+	GLuint _vao;
+
+public:
+	FullscreenTriangle();
+	~FullscreenTriangle();
+
+	/*!
+	 * Draws the triangle with the shader that is in use
+	 */
+	void draw() const;
+};
+
+FullscreenTriangle::FullscreenTriangle()
+{
+	glGenVertexArrays(1, &_vao);
+}
+
+FullscreenTriangle::~FullscreenTriangle()
+{
+	glState.deleteVertexArray(_vao);
+}
+
+void FullscreenTriangle::draw() const
+{
+	glState.bindVertexArray(_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	renderStats.drawCalls++;
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "RenderStats.h"
+
+/*!
+ * Shadow copy of the GL state the renderer changes, calls that would set a value that is already set are dropped
+ * All changes of the tracked state have to go through this class, otherwise the copy goes stale and binds are lost;
+ * invalidate() forgets everything after code that calls GL directly.
+ * Issued and skipped calls are counted in renderStats.
+ */
+class GLState
+{
+protected:
+	/*!
+	 * Value of a binding that has not been set through this class yet, the next call is always issued
+	 */
+	static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+	/*!
+	 * Number of texture units whose bindings are tracked, binds to higher units are always issued
+	 */
+	static const GLuint TEXTURE_UNITS = 16;
+
+	/*!
+	 * Number of indexed uniform and shader storage buffer bindings that are tracked
+	 */
+	static const GLuint BUFFER_BINDINGS = 8;
+
+	/*!
+	 * Texture targets with tracked bindings
+	 */
+	static const int TEXTURE_TARGETS = 2;
+
+	/*!
+	 * Buffer targets with tracked bindings, GL_ELEMENT_ARRAY_BUFFER is part of the VAO and always issued
+	 */
+	static const int BUFFER_TARGETS = 5;
+
+	/*!
+	 * Capabilities whose state is tracked
+	 */
+	static const int CAPABILITIES = 3;
+
+	GLuint _program;
+	GLuint _vertexArray;
+	GLuint _activeTexture;
+	GLuint _textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+	GLuint _buffers[BUFFER_TARGETS];
+	GLuint _uniformBuffers[BUFFER_BINDINGS];
+	GLuint _storageBuffers[BUFFER_BINDINGS];
+
+	/*!
+	 * 0 for disabled, 1 for enabled, UNKNOWN before the first change
+	 */
+	GLuint _capabilities[CAPABILITIES];
+	GLuint _depthFunc;
+	GLuint _depthMask;
+	GLuint _polygonMode;
+	GLint _viewport[4];
+
+	static int textureTarget(GLenum target);
+	static int bufferTarget(GLenum target);
+	static int capability(GLenum cap);
+
+	/*!
+	 * Counts a call and tells whether it has to be issued
+	 * @param cached: the tracked value, updated to the new one
+	 * @param value: the value the call sets
+	 * @return true if the value changes
+	 */
+	static bool change(GLuint& cached, GLuint value);
+
+	void setCapability(GLenum cap, bool enabled);
+
+public:
+	GLState();
+
+	/*!
+	 * Forgets the whole state, the next call of every kind is issued
+	 */
+	void invalidate();
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vertexArray);
+
+	/*!
+	 * Selects the texture unit that bindTexture(target, texture) binds to
+	 * @param unit: index of the unit, not GL_TEXTURE0 + index
+	 */
+	void activeTexture(GLuint unit);
+
+	/*!
+	 * Binds a texture to the active texture unit
+	 */
+	void bindTexture(GLenum target, GLuint texture);
+
+	/*!
+	 * Binds a texture to a texture unit, the unit is only activated if its binding changes
+	 * @param unit: index of the unit, not GL_TEXTURE0 + index
+	 */
+	void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	void bindBuffer(GLenum target, GLuint buffer);
+
+	/*!
+	 * Binds a buffer to an indexed binding point, which also binds it to the generic target
+	 */
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean flag);
+
+	/*!
+	 * Sets the polygon mode of front and back faces
+	 */
+	void polygonMode(GLenum mode);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	/*!
+	 * Delete GL objects and forget the bindings of their names, which GL may hand out again
+	 */
+	void deleteVertexArray(GLuint vertexArray);
+	void deleteBuffer(GLuint buffer);
+	void deleteTexture(GLuint texture);
+};
+
+GLState::GLState()
+{
+	invalidate();
+}
+
+void GLState::invalidate()
+{
+	_program = UNKNOWN;
+	_vertexArray = UNKNOWN;
+	_activeTexture = UNKNOWN;
+	for (GLuint unit = 0; unit < TEXTURE_UNITS; unit++)
+		for (int target = 0; target < TEXTURE_TARGETS; target++)
+			_textures[unit][target] = UNKNOWN;
+	for (int target = 0; target < BUFFER_TARGETS; target++)
+		_buffers[target] = UNKNOWN;
+	for (GLuint index = 0; index < BUFFER_BINDINGS; index++) {
+		_uniformBuffers[index] = UNKNOWN;
+		_storageBuffers[index] = UNKNOWN;
+	}
+	for (int cap = 0; cap < CAPABILITIES; cap++)
+		_capabilities[cap] = UNKNOWN;
+	_depthFunc = UNKNOWN;
+	_depthMask = UNKNOWN;
+	_polygonMode = UNKNOWN;
+	_viewport[0] = _viewport[1] = _viewport[2] = _viewport[3] = -1;
+}
+
+int GLState::textureTarget(GLenum target)
+{
+	switch (target) {
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_2D_ARRAY: return 1;
+	default: return -1;
+	}
+}
+
+int GLState::bufferTarget(GLenum target)
+{
+	switch (target) {
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_UNIFORM_BUFFER: return 1;
+	case GL_SHADER_STORAGE_BUFFER: return 2;
+	case GL_DRAW_INDIRECT_BUFFER: return 3;
+	case GL_PIXEL_UNPACK_BUFFER: return 4;
+	default: return -1;
+	}
+}
+
+int GLState::capability(GLenum cap)
+{
+	switch (cap) {
+	case GL_DEPTH_TEST: return 0;
+	case GL_CULL_FACE: return 1;
+	case GL_BLEND: return 2;
+	default: return -1;
+	}
+}
+
+bool GLState::change(GLuint& cached, GLuint value)
+{
+	if (cached == value) {
+		renderStats.skippedStateCalls++;
+		return false;
+	}
+	cached = value;
+	renderStats.stateCalls++;
+	return true;
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if (change(_program, program))
+		glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (change(_vertexArray, vertexArray))
+		glBindVertexArray(vertexArray);
+}
+
+void GLState::activeTexture(GLuint unit)
+{
+	if (change(_activeTexture, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+	int index = textureTarget(target);
+	if (index < 0 || _activeTexture >= TEXTURE_UNITS) {
+		renderStats.stateCalls++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (change(_textures[_activeTexture][index], texture))
+		glBindTexture(target, texture);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	int index = textureTarget(target);
+	if (index >= 0 && unit < TEXTURE_UNITS && _textures[unit][index] == texture) {
+		renderStats.skippedStateCalls++;
+		return;
+	}
+	activeTexture(unit);
+	bindTexture(target, texture);
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = bufferTarget(target);
+	if (index < 0) {
+		renderStats.stateCalls++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (change(_buffers[index], buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	GLuint* bindings = target == GL_UNIFORM_BUFFER ? _uniformBuffers : target == GL_SHADER_STORAGE_BUFFER ? _storageBuffers : nullptr;
+	if (bindings == nullptr || index >= BUFFER_BINDINGS) {
+		renderStats.stateCalls++;
+		glBindBufferBase(target, index, buffer);
+	}
+	else if (change(bindings[index], buffer))
+		glBindBufferBase(target, index, buffer);
+	else
+		return;
+
+	int generic = bufferTarget(target);
+	if (generic >= 0)
+		_buffers[generic] = buffer;
+}
+
+void GLState::setCapability(GLenum cap, bool enabled)
+{
+	int index = capability(cap);
+	if (index >= 0 && !change(_capabilities[index], enabled ? 1 : 0))
+		return;
+	if (index < 0)
+		renderStats.stateCalls++;
+
+	if (enabled)
+		glEnable(cap);
+	else
+		glDisable(cap);
+}
+
+void GLState::enable(GLenum cap)
+{
+	setCapability(cap, true);
+}
+
+void GLState::disable(GLenum cap)
+{
+	setCapability(cap, false);
+}
+
+void GLState::depthFunc(GLenum func)
+{
+	if (change(_depthFunc, func))
+		glDepthFunc(func);
+}
+
+void GLState::depthMask(GLboolean flag)
+{
+	if (change(_depthMask, flag))
+		glDepthMask(flag);
+}
+
+void GLState::polygonMode(GLenum mode)
+{
+	if (change(_polygonMode, mode))
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (_viewport[0] == x && _viewport[1] == y && _viewport[2] == width && _viewport[3] == height) {
+		renderStats.skippedStateCalls++;
+		return;
+	}
+	_viewport[0] = x;
+	_viewport[1] = y;
+	_viewport[2] = width;
+	_viewport[3] = height;
+	renderStats.stateCalls++;
+	glViewport(x, y, width, height);
+}
+
+void GLState::deleteVertexArray(GLuint vertexArray)
+{
+	if (_vertexArray == vertexArray)
+		_vertexArray = UNKNOWN;
+	glDeleteVertexArrays(1, &vertexArray);
+}
+
+void GLState::deleteBuffer(GLuint buffer)
+{
+	for (int target = 0; target < BUFFER_TARGETS; target++)
+		if (_buffers[target] == buffer)
+			_buffers[target] = UNKNOWN;
+	for (GLuint index = 0; index < BUFFER_BINDINGS; index++) {
+		if (_uniformBuffers[index] == buffer)
+			_uniformBuffers[index] = UNKNOWN;
+		if (_storageBuffers[index] == buffer)
+			_storageBuffers[index] = UNKNOWN;
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+void GLState::deleteTexture(GLuint texture)
+{
+	for (GLuint unit = 0; unit < TEXTURE_UNITS; unit++)
+		for (int target = 0; target < TEXTURE_TARGETS; target++)
+			if (_textures[unit][target] == texture)
+				_textures[unit][target] = UNKNOWN;
+	glDeleteTextures(1, &texture);
+}
+
+/*!
+ * State of the context the game renders with
+ */
+GLState glState;
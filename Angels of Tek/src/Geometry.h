@@ -12,6 +12,9 @@
 #include <glm\gtc\matrix_transform.hpp>
 #include "Material.h"
 #include "Shader.h"
+#include "RenderStats.h"
+#include "GLState.h"
+#include "Frustum.h"
 
 /*!
  * Stores all data for a geometry object
@@ -65,6 +68,11 @@ protected:
 	 */
 	unsigned int _elements;
 
+	/*!
+	 * Whether the VAO and VBOs belong to this object, false if they are shared with another one
+	 */
+	bool _ownsBuffers;
+
 	/*!
 	 * Material of the geometry object
 	 */
@@ -75,6 +83,26 @@ protected:
 	 */
 	glm::mat4 _modelMatrix;
 
+	/*!
+	 * Bounding box of the vertices in model space
+	 */
+	AABB _bounds;
+
+	/*!
+	 * Uniform handles of the material's shader, resolved once at creation
+	 */
+	Uniform<glm::mat4> _modelMatrixUniform;
+	Uniform<glm::mat3> _normalMatrixUniform;
+
+	/*!
+	 * Geometry object constructor for subclasses
+	 * @param modelMatrix: model matrix of the object
+	 * @param data: data for the geometry object
+	 * @param material: material of the geometry object
+	 * @param perObjectUniforms: whether the shader reads the model and normal matrix from uniforms
+	 */
+	Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material, bool perObjectUniforms);
+
 public:
 	/*!
 	 * Geometry object constructor
@@ -84,13 +112,54 @@ public:
 	 * @param material: material of the geometry object
 	 */
 	Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material);
-	~Geometry();
+
+	/*!
+	 * Geometry object constructor that reuses the VAO and VBOs of another object
+	 * Objects sharing their buffers are drawn as instances of one mesh by the render queue
+	 * @param modelMatrix: model matrix of the object
+	 * @param mesh: object whose buffers are used, has to outlive this one
+	 * @param material: material of the geometry object
+	 */
+	Geometry(glm::mat4 modelMatrix, const Geometry& mesh, Material* material);
+	virtual ~Geometry();
 
 	/*!
 	 * Draws the object
 	 * Uses the shader, sets the uniform and issues a draw call
 	 */
-	void draw();
+	virtual void draw();
+
+	/*!
+	 * Sets the per-object uniforms and issues the draw call
+	 * The shader of the material has to be in use and the material uniforms set
+	 */
+	virtual void drawObject();
+
+	/*!
+	 * Draws instances of the mesh with one draw call, the shader reads the instance attributes
+	 * @param count: number of instances
+	 * @param baseInstance: index of the first instance in the instance buffer
+	 */
+	void drawInstances(GLsizei count, GLuint baseInstance);
+
+	/*!
+	 * Draws the object if its bounding box intersects the frustum
+	 * @param frustum: the camera frustum
+	 */
+	virtual void draw(const Frustum& frustum);
+
+	/*!
+	 * @return the bounding box of the object in world space
+	 */
+	AABB getBounds() const;
+
+	/*!
+	 * @return the VAO of the mesh, the same for objects sharing their buffers
+	 */
+	GLuint getVao() const;
+
+	Material* getMaterial() const;
+	const glm::mat4& getModelMatrix() const;
 
 	/*!
 	 * Transforms the object, i.e. updates the model matrix
@@ -137,15 +206,20 @@ public:
 };
 
 Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material)
-	: _elements(data.indices.size()), _modelMatrix(modelMatrix), _material(material)
+	: Geometry(modelMatrix, data, material, true)
+{
+}
+
+Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material, bool perObjectUniforms)
+	: _elements(data.indices.size()), _ownsBuffers(true), _modelMatrix(modelMatrix), _material(material), _bounds(AABB::fromPoints(data.positions))
 {
 	// create VAO
 	glGenVertexArrays(1, &_vao);
-	glBindVertexArray(_vao);
+	glState.bindVertexArray(_vao);
 
 	// create positions VBO
 	glGenBuffers(1, &_vboPositions);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboPositions);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboPositions);
 	glBufferData(GL_ARRAY_BUFFER, data.positions.size() * sizeof(glm::vec3), data.positions.data(), GL_STATIC_DRAW);
 
 	// bind positions to location 0
@@ -154,7 +228,7 @@ Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material
 
 	// create normals VBO
 	glGenBuffers(1, &_vboNormals);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboNormals);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboNormals);
 	glBufferData(GL_ARRAY_BUFFER, data.normals.size() * sizeof(glm::vec3), data.normals.data(), GL_STATIC_DRAW);
 
 	// bind normals to location 1
@@ -163,7 +237,7 @@ Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material
 
 	// create VBO for UVs
 	glGenBuffers(1, &_vboUVs);
-	glBindBuffer(GL_ARRAY_BUFFER, _vboUVs);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboUVs);
 	glBufferData(GL_ARRAY_BUFFER, data.uvs.size() * sizeof(glm::vec2), data.uvs.data(), GL_STATIC_DRAW);
 
 	// bind UVs to location 2
@@ -175,31 +249,88 @@ Geometry::Geometry(glm::mat4 modelMatrix, GeometryData& data, Material* material
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _vboIndices);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), data.indices.data(), GL_STATIC_DRAW);
 
-	glBindVertexArray(0);
+	glState.bindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if (perObjectUniforms) {
+		Shader* shader = _material->getShader();
+		_modelMatrixUniform = shader->getUniform<glm::mat4>("modelMatrix");
+		_normalMatrixUniform = shader->getUniform<glm::mat3>("normalMatrix");
+	}
+}
+
+Geometry::Geometry(glm::mat4 modelMatrix, const Geometry& mesh, Material* material)
+	: _vao(mesh._vao), _vboPositions(mesh._vboPositions), _vboNormals(mesh._vboNormals), _vboUVs(mesh._vboUVs), _vboIndices(mesh._vboIndices),
+	_elements(mesh._elements), _ownsBuffers(false), _material(material), _modelMatrix(modelMatrix), _bounds(mesh._bounds)
+{
+	Shader* shader = _material->getShader();
+	_modelMatrixUniform = shader->getUniform<glm::mat4>("modelMatrix");
+	_normalMatrixUniform = shader->getUniform<glm::mat3>("normalMatrix");
 }
 
 Geometry::~Geometry()
 {
-	glDeleteBuffers(1, &_vboPositions);
-	glDeleteBuffers(1, &_vboNormals);
-	glDeleteBuffers(1, &_vboUVs);
-	glDeleteBuffers(1, &_vboIndices);
-	glDeleteVertexArrays(1, &_vao);
+	if (!_ownsBuffers) return;
+
+	glState.deleteBuffer(_vboPositions);
+	glState.deleteBuffer(_vboNormals);
+	glState.deleteBuffer(_vboUVs);
+	glState.deleteBuffer(_vboIndices);
+	glState.deleteVertexArray(_vao);
 }
 
 void Geometry::draw()
 {
 	Shader* shader = _material->getShader();
 	shader->use();
-
-	shader->setMat4("modelMatrix", _modelMatrix);
 	_material->setUniforms();
-	shader->setMat3("normalMatrix", glm::mat3(glm::transpose(glm::inverse(_modelMatrix))));
+	drawObject();
+}
 
-	glBindVertexArray(_vao);
+void Geometry::drawObject()
+{
+	Shader* shader = _material->getShader();
+	shader->set(_modelMatrixUniform, _modelMatrix);
+	shader->set(_normalMatrixUniform, glm::mat3(glm::transpose(glm::inverse(_modelMatrix))));
+
+	glState.bindVertexArray(_vao);
 	glDrawElements(GL_TRIANGLES, _elements, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	renderStats.drawCalls++;
+}
+
+void Geometry::drawInstances(GLsizei count, GLuint baseInstance)
+{
+	if (count <= 0) return;
+
+	glState.bindVertexArray(_vao);
+	glDrawElementsInstancedBaseInstance(GL_TRIANGLES, _elements, GL_UNSIGNED_INT, 0, count, baseInstance);
+	renderStats.drawCalls++;
+}
+
+void Geometry::draw(const Frustum& frustum)
+{
+	if (frustum.test(getBounds()))
+		draw();
+}
+
+AABB Geometry::getBounds() const
+{
+	return _bounds.transform(_modelMatrix);
+}
+
+GLuint Geometry::getVao() const
+{
+	return _vao;
+}
+
+Material* Geometry::getMaterial() const
+{
+	return _material.get();
+}
+
+const glm::mat4& Geometry::getModelMatrix() const
+{
+	return _modelMatrix;
 }
 
 void Geometry::transform(glm::mat4 transformation)
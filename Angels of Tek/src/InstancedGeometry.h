@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm\glm.hpp>
+#include "Geometry.h"
+
+/*!
+ * Per-instance data of an instanced geometry object
+ * Read by the vertex shader at attribute locations 3-6 (model matrix) and 7 (material index)
+ */
+struct InstanceData {
+	/*!
+	 * Model matrix of the instance
+	 */
+	glm::mat4 modelMatrix;
+	/*!
+	 * Index of the material the instance is drawn with
+	 */
+	GLuint materialIndex;
+};
+
+/*!
+ * Geometry that is shared by many instances, each with its own model matrix and material index
+ * All instances (or a contiguous range of them) are drawn with a single instanced draw call
+ */
+class InstancedGeometry : public Geometry
+{
+protected:
+	/*!
+	 * Vertex buffer object that stores the per-instance data
+	 */
+	GLuint _vboInstances;
+
+	/*!
+	 * Number of instances in the instance buffer
+	 */
+	GLsizei _instanceCount;
+
+	/*!
+	 * All instances and their bounding boxes in world space
+	 */
+	std::vector<InstanceData> _instances;
+	BoundsSoA _instanceBounds;
+
+	/*!
+	 * The instances changed since the instance buffer was last written
+	 */
+	bool _stale;
+
+	/*!
+	 * Per-frame culling results, kept to reuse their memory
+	 */
+	std::vector<unsigned char> _visible;
+	std::vector<InstanceData> _visibleInstances;
+
+	/*!
+	 * Replaces the contents of the instance buffer
+	 */
+	void upload(const std::vector<InstanceData>& instances);
+
+public:
+	/*!
+	 * Instanced geometry object constructor
+	 * Creates the shared VAO and VBOs and an empty instance buffer
+	 * @param data: data for the shared geometry
+	 * @param material: material of the geometry object, its shader has to read the instance attributes
+	 */
+	InstancedGeometry(GeometryData& data, Material* material);
+	~InstancedGeometry();
+
+	/*!
+	 * Replaces the instances of the object without uploading them, the next cull() or draw() writes the instance buffer
+	 * @param instances: the new instance data, swapped in, receives the previous instances so their memory can be reused
+	 */
+	void setInstances(std::vector<InstanceData>& instances);
+
+	/*!
+	 * Sets the instance attributes of the bound VAO to the instance data in the bound GL_ARRAY_BUFFER
+	 */
+	static void setupInstanceAttributes();
+
+	/*!
+	 * Draws all instances with one draw call, or the visible ones after cull() if the instances did not change since
+	 */
+	void draw() override;
+
+	/*!
+	 * Draws the instances in the instance buffer, the shader has to be in use and the material uniforms set
+	 */
+	void drawObject() override;
+
+	/*!
+	 * Culls the instances against the frustum and compacts the visible ones at the start of the instance buffer
+	 * @param frustum: the camera frustum
+	 */
+	void cull(const Frustum& frustum);
+
+	/*!
+	 * Culls the instances against the frustum, compacts the visible ones at the start of the
+	 * instance buffer and draws them with one draw call
+	 * @param frustum: the camera frustum
+	 */
+	void draw(const Frustum& frustum) override;
+
+	/*!
+	 * Draws a contiguous range of the instance buffer with one draw call
+	 * @param firstInstance: index of the first instance to draw
+	 * @param count: number of instances to draw
+	 */
+	void draw(GLuint firstInstance, GLsizei count);
+};
+
+InstancedGeometry::InstancedGeometry(GeometryData& data, Material* material)
+	: Geometry(glm::mat4(1.0f), data, material, false), _instanceCount(0), _stale(false)
+{
+	glState.bindVertexArray(_vao);
+
+	glGenBuffers(1, &_vboInstances);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+	setupInstanceAttributes();
+
+	glState.bindVertexArray(0);
+	glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstancedGeometry::setupInstanceAttributes()
+{
+	// bind the model matrix to locations 3-6, one column per location
+	for (GLuint column = 0; column < 4; column++) {
+		glEnableVertexAttribArray(3 + column);
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(3 + column, 1);
+	}
+
+	// bind the material index to location 7
+	glEnableVertexAttribArray(7);
+	glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(InstanceData), (void*)offsetof(InstanceData, materialIndex));
+	glVertexAttribDivisor(7, 1);
+}
+
+InstancedGeometry::~InstancedGeometry()
+{
+	glState.deleteBuffer(_vboInstances);
+}
+
+void InstancedGeometry::setInstances(std::vector<InstanceData>& instances)
+{
+	_instances.swap(instances);
+
+	_instanceBounds.clear();
+	for (const InstanceData& instance : _instances)
+		_instanceBounds.push_back(_bounds.transform(instance.modelMatrix));
+
+	_stale = true;
+}
+
+void InstancedGeometry::upload(const std::vector<InstanceData>& instances)
+{
+	_instanceCount = (GLsizei)instances.size();
+
+	// orphan the previous storage, the buffer is rewritten every frame while culling
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+	glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_DYNAMIC_DRAW);
+	_stale = false;
+}
+
+void InstancedGeometry::draw()
+{
+	if (_stale)
+		upload(_instances);
+	draw(0, _instanceCount);
+}
+
+void InstancedGeometry::draw(const Frustum& frustum)
+{
+	cull(frustum);
+	draw(0, _instanceCount);
+}
+
+void InstancedGeometry::cull(const Frustum& frustum)
+{
+	frustum.cull(_instanceBounds, _visible);
+
+	_visibleInstances.clear();
+	for (size_t i = 0; i < _instances.size(); i++) {
+		if (_visible[i])
+			_visibleInstances.push_back(_instances[i]);
+	}
+
+	upload(_visibleInstances);
+}
+
+void InstancedGeometry::drawObject()
+{
+	if (_stale)
+		upload(_instances);
+	drawInstances(_instanceCount, 0);
+}
+
+void InstancedGeometry::draw(GLuint firstInstance, GLsizei count)
+{
+	if (count <= 0) return;
+
+	Shader* shader = _material->getShader();
+	shader->use();
+	_material->setUniforms();
+	drawInstances(count, firstInstance);
+}
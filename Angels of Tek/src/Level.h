@@ -1,66 +1,159 @@
 #ifndef LEVEL_H
 #define LEVEL_H
 
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
+#include "Beatmap.h"
+
+// z range an obstacle occupies in its lane
+struct ObstacleSpan {
+	float zMin;
+	float zMax;
+};
+
 class Level
 {
 public:
-	int coutner = 0;
-
-	vector <glm::vec4> level1;
-	Level(string wtf, float bpm, float offset) {
-		float bps = 1.0f / (bpm / 60.0f);
-		offset *= 0.0f;
-
-		for (int i = 0; i < 100; i++)
-		{
-			//level1.push_back(glm::vec4(rand() % 5 - 2, -1 * i * 2 - 25, 1, 4));
-			//level1.push_back(glm::vec4(rand() % 5 - 2, -i * 4, 1, 4));
-			level1.push_back(glm::vec4(rand() % 5 - 2, (-i * bps * 4.0f) - offset, 1, 4));
-			//std::cout << -i * bps * 4.0f << std::endl;
+	static const int LANE_COUNT = 5;
+
+	// loads the beatmap at path, if there is none the old random level is generated instead
+	// startZ is where the runner is at time 0 of the track
+	Level(string path, float bpm, float startZ) : startZ(startZ) {
+		if (!beatmap.open(path.c_str()) || beatmap.laneCount() != LANE_COUNT) {
+			std::cout << "ERROR::LEVEL::BEATMAP_NOT_LOADED " << path << ", generating a level" << std::endl;
+
+			float bps = 1.0f / (bpm / 60.0f);
+			float speed = Beatmap::DEFAULT_SPEED;
+
+			vector<BeatmapNote> notes;
+			for (int i = 0; i < 100; i++)
+			{
+				// same spacing as before: one obstacle every four beats of z, the first one at z = 0
+				BeatmapNote note = {};
+				note.time = (startZ + i * bps * 4.0f) / speed;
+				note.lane = (uint8_t)(rand() % LANE_COUNT);
+				note.type = (uint8_t)(i % 4);
+				notes.push_back(note);
+			}
+			beatmap.load(Beatmap::encode(bpm, speed, LANE_COUNT, notes));
 		}
-		//level1.push_back(glm::vec4(-2, -6, 1, 4));
-		//level1.push_back(glm::vec4(-1, -9, 1, 4));
-		//level1.push_back(glm::vec4(0, -10, 1, 4));
-		//level1.push_back(glm::vec4(1, -11, 1, 4));
-		//level1.push_back(glm::vec4(2, -12, 1, 4));
-		//level1.push_back(glm::vec4(-2, -13, 1, 4));
-		//level1.push_back(glm::vec4(-1, -15, 1, 4));
-		//level1.push_back(glm::vec4(0, -17, 1, 4));
-		//level1.push_back(glm::vec4(1, -18, 1, 4));
-		//level1.push_back(glm::vec4(2, -19, 1, 4));
+
+		finishZ = noteZ(beatmap.endTime());
+		reset();
 	};
 
+	// distance the runner has to move per second to reach every note at its time
+	float speed() const {
+		return beatmap.speed();
+	}
+
+	// z of a point in time, the runner moves towards -z with the speed of the beatmap
+	float noteZ(float time) const {
+		return startZ - time * beatmap.speed();
+	}
+
+	// time at which the runner reaches a z
+	float zTime(float z) const {
+		return (startZ - z) / beatmap.speed();
+	}
+
+	// z range a note occupies, every obstacle is one unit deep plus the length of the note
+	ObstacleSpan noteSpan(const BeatmapNote &note) const {
+		ObstacleSpan span = { noteZ(note.time + note.length) - 0.5f, noteZ(note.time) + 0.5f };
+		return span;
+	}
+
+	// calls callback(note, span) for every note of a lane that overlaps [zFrom, zTo]
+	// notes are sorted by time, so only notes starting within the longest note before the interval can reach into it
+	template <typename Callback>
+	void forEachInLane(int lane, float zFrom, float zTo, Callback callback) const {
+		// z decreases with time, so the far end of the interval is the later time
+		float timeFrom = zTime(zTo + 0.5f);
+		float timeTo = zTime(zFrom - 0.5f);
+
+		unsigned int count = beatmap.noteCount(lane);
+		for (unsigned int i = beatmap.lowerBound(lane, timeFrom - beatmap.longestNote(lane)); i < count; i++) {
+			const BeatmapNote &note = beatmap.note(lane, i);
+			if (note.time > timeTo) break;
+
+			ObstacleSpan span = noteSpan(note);
+			if (span.zMax >= zFrom && span.zMin <= zTo)
+				callback(note, span);
+		}
+	}
+
+	// calls callback(x, span, type) for every obstacle that overlaps [zFrom, zTo], x goes from -2 to 2
+	template <typename Callback>
+	void forEachObstacle(float zFrom, float zTo, Callback callback) const {
+		for (int lane = 0; lane < LANE_COUNT; lane++) {
+			forEachInLane(lane, zFrom, zTo, [&](const BeatmapNote &note, const ObstacleSpan &span) {
+				callback((float)(lane - LANE_COUNT / 2), span, note.type);
+			});
+		}
+	}
+
+	// number of obstacles of a lane that overlap [zFrom, zTo]
+	int obstaclesInInterval(int lane, float zFrom, float zTo) const {
+		int count = 0;
+		forEachInLane(lane, zFrom, zTo, [&](const BeatmapNote &, const ObstacleSpan &) { count++; });
+		return count;
+	}
+
 	// sophisticated collision detection algorithm
-	double collision(Camera camera, double delta) {
-		glm::vec4 obstacle = level1.at(coutner);
-
-		if (camera.Position.z < obstacle.y && coutner < level1.size() - 1)
-			coutner++;
-
-		if (camera.line - 3 == obstacle.x) {
-			if (camera.Position.z - 1 > (obstacle.y - 0.5f) && camera.Position.z - 1 < (obstacle.y + 0.5f)) {
-				//std::cout << delta * 200 << std::endl;
-				if (delta * 200 == 0) {
-					return 1;
-				}
-				else {
-					return delta * 200;
-				}
-				
-			}
+	// tests everything the runner swept over since the last call in its lane, call once per frame
+	double collision(const Camera &camera, double delta) {
+		// the runner is one unit in front of the camera
+		float runnerZ = camera.Position.z - 1;
+		float zFrom = runnerZ;
+		float zTo = runnerZ;
+
+		// the runner moves towards -z, sweep back to where it was in the last frame unless the camera jumped back
+		if (hasLastRunnerZ && lastRunnerZ > runnerZ)
+			zTo = lastRunnerZ;
+		lastRunnerZ = runnerZ;
+		hasLastRunnerZ = true;
+		cameraZ = camera.Position.z;
+
+		int lane = camera.line - 1;
+		if (lane < 0 || lane >= LANE_COUNT || obstaclesInInterval(lane, zFrom, zTo) == 0)
+			return 0;
+
+		//std::cout << delta * 200 << std::endl;
+		if (delta * 200 == 0) {
+			return 1;
+		}
+		else {
+			return delta * 200;
 		}
-		return 0;
 	}
 
+	// the camera passed the last obstacle
 	bool win() {
-		if (coutner >= level1.size() - 1)
-			return true;
-		return false;
+		return beatmap.isOpen() && cameraZ < finishZ;
+	}
+
+	// starts the level over, call when the camera is reset
+	void reset() {
+		hasLastRunnerZ = false;
+		cameraZ = FLT_MAX;
 	}
 
 private:
+	// notes of every lane, read from the mapped file as the runner advances
+	Beatmap beatmap;
+
+	// z of the runner at time 0 of the track
+	float startZ;
+
+	// z where the last obstacle ends, the level is won once the camera is past it
+	float finishZ;
+
+	// positions of the last collision test
+	bool hasLastRunnerZ;
+	float lastRunnerZ;
+	float cameraZ;
 
 };
 #endif
\ No newline at end of file
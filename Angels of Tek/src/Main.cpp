@@ -10,8 +10,19 @@
 #include "Camera.h"
 #include "Model.h"
 #include "Geometry.h"
+#include "GLState.h"
+#include "InstancedGeometry.h"
+#include "RenderQueue.h"
+#include "MaterialPalette.h"
+#include "TextureLoader.h"
+#include "Terrain.h"
+#include "FullscreenTriangle.h"
 #include "Level.h"
 #include "Light.h"
+#include "Benchmark.h"
+#include "PerFrameUniforms.h"
+#include "Simulation.h"
+#include "FramePacer.h"
 
 #include <iostream>
 #include <sstream>
@@ -24,12 +35,9 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-unsigned int loadTexture(const char *path);
-void moveMoveableObject(Geometry& obj);
-void setPerFrameUniforms(Shader* shader, Camera& camera/*, DirectionalLight& dirL, PointLight& pointL*/);
+void setPerFrameUniforms(PerFrameUniforms& perFrame, Camera& camera, float time, glm::vec3 skyColor);
 void teleportRoom();
 float lerp(float a, float b, float f);
-float snoise(glm::vec2 v);
 
 static void APIENTRY DebugCallbackDefault(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const GLvoid* userParam);
 static std::string FormatDebugOutput(GLenum source, GLenum type, GLuint id, GLenum severity, const char* msg);
@@ -37,22 +45,17 @@ static std::string FormatDebugOutput(GLenum source, GLenum type, GLuint id, GLen
 // globals
 static bool _wireframe = false;
 static bool _culling = true;
-int score = 0;
-Level level("😡", 200.0f, 4.0f);
-float movingObjPos = 0.5f;
-int temp = 1;
+// the runner starts one unit in front of the camera, which starts at z = 3
+Level level("assets/beatmaps/level1.aotb", 200.0f, 2.0f);
 glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-bool pause = true;
-int life = 196;
 glm::vec3 skyBlue = glm::vec3(0.0f, 0.4f, 0.6f);
 glm::vec3 skyRed = glm::vec3(0.8f, 0.0f, 0.1f);
 glm::vec3 skyGreen = glm::vec3(0.0f, 0.8f, 0.1f);
-int framesSinceLastDamage = 100;
-bool room = false;
 
 // settings
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 768;
+const float FAR_PLANE = 100.0f;
 float brightness = 1.0f;
 
 // camera
@@ -61,15 +64,18 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// at most one frame queued on the GPU besides the one being recorded, so key presses are sampled late
+FramePacer framePacer(2);
 
-int main()
+int main(int argc, char** argv)
 {
+	Benchmark benchmark(argc, argv);
+	if (benchmark.noiseBenchmark())
+		return benchmark.runNoiseBenchmark();
+
 	// glfw: initialize and configure
 	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
@@ -77,6 +83,9 @@ int main()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+	if (benchmark.enabled())
+		benchmark.configureWindow();
+
 	// glfw window creation
 	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Angels of Tek", NULL, NULL);
 	if (window == NULL)
@@ -101,159 +110,205 @@ int main()
 		return -1;
 	}
 
-	// configure global opengl state
-	glEnable(GL_DEPTH_TEST);
+	if (benchmark.enabled())
+		benchmark.init();
+	framePacer.init();
+
+	// configure global opengl state, all state changes go through glState so redundant ones are dropped
+	glState.enable(GL_DEPTH_TEST);
 
 	// configure camera settings
-	camera.MovementSpeed = 4.0f;
+	// the runner has to move at the speed of the beatmap to reach every note at its time
+	camera.MovementSpeed = level.speed();
 	camera.MouseSensitivity = 1.5f;
 
+	// game logic runs on its own thread at a fixed rate, the render loop draws the snapshots it publishes
+	// key presses reach it through the window, see key_callback
+	Simulation simulation(level, camera);
+	glfwSetWindowUserPointer(window, &simulation);
+
 	// load shader & set up texture positions
 	Shader basicShader("pbr.vert", "pbr.frag");
 	Shader oldBasicShader("model.vert", "model.frag");
 	Shader planesWalker("simon.fag", "phongPhong.frag");
-	Shader himmerlblau("simon - Kopie.fag", "yannic - Kopie.geil");
-	
+	Shader himmerlblau("sky.vert", "yannic - Kopie.geil");
+	Shader obstacleShader("pbr_instanced.vert", "pbr.frag");
+	Shader batchedShader("pbr_batched.vert", "pbr.frag");
 
 	basicShader.use();
 	basicShader.setInt("albedoMap", 0);
 	basicShader.setInt("normalMap", 1);
-	basicShader.setInt("metallicMap", 2);
-	basicShader.setInt("roughnessMap", 3);
-	basicShader.setInt("aoMap", 4);
-
-	GLuint albedoTitanium = loadTexture("assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_basecolor.png");
-	GLuint normalTitanium = loadTexture("assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_normal.png");
-	GLuint metallicTitanium = loadTexture("assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_metallic.png");
-	GLuint roughnessTitanium = loadTexture("assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_roughness.png");
-	GLuint aoTitanium = loadTexture("assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_ao.png");
-
-	GLuint albedoCopper = loadTexture("assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-alb.png");
-	GLuint normalCopper = loadTexture("assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-normal.png");
-	GLuint metallicCopper = loadTexture("assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-metal.png");
-	GLuint roughnessCopper = loadTexture("assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-rough.png");
-	GLuint aoCopper = loadTexture("assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-ao.png");
-
-	//GLuint albedoGranite = loadTexture("assets/textures/pbr/graniterockface1-Unreal-Engine/graniterockface1_Base_Color.png");
-	//GLuint normalGranite = loadTexture("assets/textures/pbr/graniterockface1-Unreal-Engine/graniterockface1_Normal.png");
-	//GLuint metallicGranite = loadTexture("assets/textures/pbr/graniterockface1-Unreal-Engine/graniterockface1_Metallic.png");
-	//GLuint roughnessGranite = loadTexture("assets/textures/pbr/graniterockface1-Unreal-Engine/graniterockface1_Roughness.png");
-	//GLuint aoGranite = loadTexture("assets/textures/pbr/graniterockface1-Unreal-Engine/graniterockface1_Ambient_Occlusion.png");
-
-	GLuint albedoGranite = loadTexture("assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Base_Color.png");
-	GLuint normalGranite = loadTexture("assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Normal-dx.png");
-	GLuint metallicGranite = loadTexture("assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Metallic.png");
-	GLuint roughnessGranite = loadTexture("assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Roughness.png");
-	GLuint aoGranite = loadTexture("assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Ambient_Occlusion.png");
-
-	GLuint albedoPlastic = loadTexture("assets/textures/pbr/plasticpattern1-ue/plasticpattern1-albedo.png");
-	GLuint normalPlastic = loadTexture("assets/textures/pbr/plasticpattern1-ue/plasticpattern1-normal2b.png");
-	GLuint metallicPlastic = loadTexture("assets/textures/pbr/plasticpattern1-ue/plasticpattern1-metalness.png");
-	GLuint roughnessPlastic = loadTexture("assets/textures/pbr/plasticpattern1-ue/plasticpattern1-roughness2.png");
-	GLuint aoPlastic = loadTexture("assets/textures/pbr/plasticpattern1-ue/foam-grip1-ao.png");
-
-
-	// initialize static shader uniforms before rendering
-	// --------------------------------------------------
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+	basicShader.setInt("ormMap", 2);
+
+	// textures are decoded on worker threads and uploaded while the first frames are already drawn
+	TextureLoader textureLoader;
+
+	// load the PBR sets into one texture array per channel, a material is selected by its layer index
+	// lane and container only have an albedo map and reuse the plastic maps for the other channels
+	// the remaining layers take the textures of the batched models
+	MaterialPalette palette(2048, 16, &textureLoader);
+	GLint paletteGranite = palette.add({
+		"assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Base_Color.png",
+		"assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Normal-dx.png",
+		"assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Metallic.png",
+		"assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Roughness.png",
+		"assets/textures/pbr/dirtwithrocks-dx/dirtwithrocks_Ambient_Occlusion.png" });
+	GLint paletteCopper = palette.add({
+		"assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-alb.png",
+		"assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-normal.png",
+		"assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-metal.png",
+		"assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-rough.png",
+		"assets/textures/pbr/copper-rock1-Unreal-Engine/copper-rock1-ao.png" });
+	GLint paletteTitanium = palette.add({
+		"assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_basecolor.png",
+		"assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_normal.png",
+		"assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_metallic.png",
+		"assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_roughness.png",
+		"assets/textures/pbr/Titanium-Scuffed/Titanium-Scuffed_ao.png" });
+	GLint palettePlastic = palette.add({
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-albedo.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-normal2b.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-metalness.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-roughness2.png",
+		"assets/textures/pbr/plasticpattern1-ue/foam-grip1-ao.png" });
+	GLint paletteContainer = palette.add({
+		"assets/textures/container.jpg",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-normal2b.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-metalness.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-roughness2.png",
+		"assets/textures/pbr/plasticpattern1-ue/foam-grip1-ao.png" });
+	GLint paletteLane = palette.add({
+		"assets/textures/lane.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-normal2b.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-metalness.png",
+		"assets/textures/pbr/plasticpattern1-ue/plasticpattern1-roughness2.png",
+		"assets/textures/pbr/plasticpattern1-ue/foam-grip1-ao.png" });
+
 	basicShader.use();
-	basicShader.setMat4("viewProjMatrix", projection);
+	palette.setSamplers(basicShader);
+	obstacleShader.use();
+	palette.setSamplers(obstacleShader);
+	batchedShader.use();
+	palette.setSamplers(batchedShader);
+
 
 	// load & position model
-	Model ourModel("assets/models/nanosuit/nanosuit.obj");
-	Model hammer("assets/models/hammer/12221_Cat_v1_l3.obj");
+	// the nanosuit shares one vertex and index buffer and is drawn with a single multi draw
+	ModelBatch modelBatch(VertexFormat::QUANTIZED, &palette);
+	Model ourModel("assets/models/nanosuit/nanosuit.obj", glm::mat4(1.0f), false, &textureLoader, true, &modelBatch);
+	Model hammer("assets/models/hammer/12221_Cat_v1_l3.obj", glm::mat4(1.0f), false, &textureLoader, true);
+	modelBatch.finish();
+	palette.finish();
 
 	// generate Materials
-	Material cubePhongMaterial(&basicShader, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.7f, 0.1f), 2.0f);
-	Material cubePhongMaterial2(&basicShader, glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(1.0f, 0.7f, 0.1f), 2.0f);
+	PbrMaterial cubePhongMaterial(&basicShader, palettePlastic);
+	PbrMaterial cubePhongMaterial2(&basicShader, paletteContainer);
+	PbrMaterial laneMaterial(&basicShader, paletteLane);
 	Material polaneswalkerMaterial(&planesWalker, glm::vec3(0.6f, 0.1f, 0.4f), glm::vec3(0.1f, 0.7f, 0.1f), 3.0f);
-	Material himmerlblauMaterial(&himmerlblau, glm::vec3(0.0f, 1.0f, 1.0f), glm::vec3(1.0f, 0.7f, 0.1f), 2.0f);
+	Material obstacleMaterial(&obstacleShader, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.7f, 0.1f), 2.0f);
 	
-	// generate lanes
-	Geometry lane1 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &cubePhongMaterial);
-	Geometry lane2 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &cubePhongMaterial);
-	Geometry lane3 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &cubePhongMaterial);
-	Geometry lane4 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &cubePhongMaterial);
-	Geometry lane5 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &cubePhongMaterial);
-
-	// create plane
-	const int width = 100;
-	const int height = 8000;
-	Geometry plane = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(-0.5 * (width - 1), -1, -200)), Geometry::createPlaneGeometry(width, height), &polaneswalkerMaterial);
+	// generate lanes, they share the buffers of the first one so the render queue draws them as instances
+	Geometry lane1 = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, -0.4f, 0.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 1000.0f), &laneMaterial);
+	Geometry lane2(glm::translate(glm::mat4(1.0f), glm::vec3(-1.0f, -0.4f, 0.0f)), lane1, &laneMaterial);
+	Geometry lane3(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.4f, 0.0f)), lane1, &laneMaterial);
+	Geometry lane4(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, -0.4f, 0.0f)), lane1, &laneMaterial);
+	Geometry lane5(glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, -0.4f, 0.0f)), lane1, &laneMaterial);
+
+	// create plane, streamed in chunks of 32 rows around the camera with coarser grids in the distance
+	Terrain plane(&polaneswalkerMaterial, 96, 32, FAR_PLANE, 16.0f, -48.0f, -1.0f);
 	//Geometry plane = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(0, -1, -3)), Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), &polaneswalkerMaterial);
-	Geometry sky = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(-0.5 * (width - 1), 5, -200)), Geometry::createPlaneGeometry(width, height), &himmerlblauMaterial);
+
+	// sky, shaded per pixel after all opaque geometry
+	FullscreenTriangle sky;
 
 	// moving cube
 	Geometry movableObjectThatIsNotASimpleFirstPersonCamera = Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.50f, -40.0f)), Geometry::createCubeGeometry(0.2f, 0.2f, 0.2f), &cubePhongMaterial2);
 
-	// generate obstacles
-	vector<Geometry> testicles;
-	for (int i = 0; i < level.level1.size(); i++)
-	{
-		glm::vec4 pos = level.level1.at(i);
-		testicles.push_back(Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(pos.x, 0.0f, pos.y)), Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), &cubePhongMaterial));
-	}
+	// obstacles, all of them share one cube and are drawn instanced
+	// every instance selects its material from the palette by the obstacle type, so all obstacles are a single draw
+	// the instances are rebuilt every frame from the part of the beatmap that is in view
+	const GLint obstacleMaterials[] = { paletteGranite, paletteCopper, paletteTitanium, palettePlastic };
+	vector<InstanceData> obstacleInstances;
+	InstancedGeometry obstacles(Geometry::createCubeGeometry(1.0f, 1.0f, 1.0f), &obstacleMaterial);
 
 	Geometry WtfOhneDemCubeGehtDasProgrammNichtKannstDuMirDasErklärenSiomonWesp (Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)), Geometry::createCubeGeometry(0.5f, 0.5f, 0.5f), &cubePhongMaterial));
 
 	// Cheat R00m Kugel
 	Geometry showcase (Geometry(glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, 0)), Geometry::createCubeGeometry(0.5, 0.5, 0.5), &cubePhongMaterial));
 
-	// load cube textures
-	GLuint containerTextureID = loadTexture("assets/textures/container.jpg");
-	GLuint containerTextureID2 = loadTexture("assets/textures/container2.png");
-	GLuint laneTexture= loadTexture("assets/textures/lane.png");
+	// draws of the frame, sorted by program, material and mesh
+	// geometry with palette materials is instanced with the shading of the obstacles
+	RenderQueue renderQueue;
+	renderQueue.setInstancedShader(&basicShader, &obstacleShader);
 
 	// Initialize lights
 	DirectionalLight dirL(glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(0, -0.5f, -1));
 	PointLight pointL(glm::vec3(1.0f), glm::vec3(0, -10, 0), glm::vec3(1, 0.4, 0.1));
 
-	// start sound engine
-	irrklang::ISoundEngine* engine = irrklang::createIrrKlangDevice();
-	engine->play2D("assets/geile mukke ballern/Helblinde - Gateway to Psycho.mp3");
+	// per-frame uniform block shared by all shaders, static lights are stored once
+	PerFrameUniforms perFrame;
+	perFrame.setDirectionalLight(dirL);
+	perFrame.setPointLight(pointL);
+	perFrame.setLight(0, glm::vec3(0, 0.2, +5), glm::vec3(150.0f, 150.0f, 150.0f));
+
+	// start sound engine, benchmark runs stay silent
+	irrklang::ISoundEngine* engine = benchmark.enabled() ? NULL : irrklang::createIrrKlangDevice();
+	if (engine)
+		engine->play2D("assets/geile mukke ballern/Helblinde - Gateway to Psycho.mp3");
 	//engine->play2D("assets/geile mukke ballern/LMFAO - Party Rock Anthem.mp3");
 
+	// benchmark frames have to be comparable, so they start with all textures loaded
+	if (benchmark.enabled())
+		textureLoader.finish();
+
+	// benchmark runs tick the simulation on this thread instead, so every run renders the same frames
+	if (!benchmark.enabled())
+		simulation.start();
+	unsigned int playedDamageSounds = 0;
+
 	// render loop
 	// -----------
 	while (!glfwWindowShouldClose(window))
 	{
-		// per-frame time logic
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-		if (!pause) {
-			camera.ProcessKeyboard(FORWARD, deltaTime);
+		// wait for the GPU to catch up first, then poll, so the frame starts with the freshest input
+		framePacer.wait();
+		glfwPollEvents();
+
+		// per-frame time logic, benchmark runs advance by a fixed timestep
+		float currentFrame;
+		if (benchmark.enabled()) {
+			currentFrame = benchmark.time();
+			benchmark.replayInput(window, key_callback);
+			benchmark.beginFrame();
+			simulation.advanceTo(currentFrame);
 		}
+		else {
+			currentFrame = (float)simulation.clock();
+		}
+		renderStats.inputLatencyMs = framePacer.latency();
+
+		// game state of this frame, interpolated between the last two ticks
+		FrameSnapshot frame = simulation.snapshot(currentFrame);
+		camera.Position = frame.cameraPosition;
+
+		// upload the textures decoded since the last frame
+		textureLoader.update();
 
 		// Score as window title
 		//std::stringstream str;
-		//str << level.coutner;
+		//str << score;
 		//glfwSetWindowTitle(window, str.str().c_str());
 
 		// Lifes as window title
 		std::stringstream str;
-		str << life;
+		str << frame.life;
 		glfwSetWindowTitle(window, str.str().c_str());
 
-		framesSinceLastDamage += 1;
-		if (framesSinceLastDamage > 50)
-			framesSinceLastDamage = 50;
-
-		// Damage is now calculated with deltatime => framerate independent
-		life -= level.collision(camera, deltaTime);
-
-		if (level.collision(camera, deltaTime) > 0){
-			if (framesSinceLastDamage > 1)
+		// damage is calculated by the simulation, sounds are played here so they stay on one thread
+		if (frame.damageSounds != playedDamageSounds) {
+			if (engine)
 				engine->play2D("assets/geile mukke ballern/Minecraft Original Damage Sound.mp3");
-
-			framesSinceLastDamage = 0;
-		}
-
-		if (life <= 0) {
-			level.coutner = 0;
-			camera.ProcessKeyboard(RESET, deltaTime);
-			pause = true;
-			life = 200;
+			playedDamageSounds = frame.damageSounds;
 		}
 
 		glm::vec3 skyBlue = glm::vec3(0.0f, 0.4f, 0.6f);
@@ -261,18 +316,16 @@ int main()
 		glm::vec3 skyGreen = glm::vec3(0.0f, 0.8f, 0.1f);
 
 		// calc bg color
-		float damageFactor = (float)1.0 - (float)((float)framesSinceLastDamage / 50);
-		glm::vec3 bgColor = glm::vec3(glm::mix(skyBlue, skyRed, damageFactor));
+		glm::vec3 bgColor = glm::vec3(glm::mix(skyBlue, skyRed, frame.damageFactor));
 
 		// Collision / win condition
-		if (level.win()) {
+		if (frame.won) {
 			std::cout << "Win" << std::endl;
 			glfwSetWindowTitle(window, "Win");
 			bgColor = skyGreen;
 		}
 
 		// reset
-		glfwPollEvents();
 		glClearColor(bgColor.x, bgColor.y, bgColor.z, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -281,206 +334,105 @@ int main()
 		color.y = (rand() % 100) / 100.0f;
 		color.z = (rand() % 100) / 100.0f;
 		glClearColor(color.x, color.y, color.z, color.w);*/
-		
 
-		basicShader.use();
-		setPerFrameUniforms(&basicShader, camera);
+		setPerFrameUniforms(perFrame, camera, currentFrame, bgColor);
+		Frustum frustum(perFrame.data.viewProjMatrix);
+		palette.bind();
 
-		// move & draw model
+		renderQueue.begin(camera.Position, FAR_PLANE);
+
+		// move & draw model, its textures are layers of the palette
 		ourModel.resetModelMatrix();
 		ourModel.transform(glm::rotate(glm::mat4(1.0f), -1.35f, glm::vec3(1.0f, 0.0f, 0.0f)));
 		ourModel.transform(glm::scale(glm::mat4(1.0f), glm::vec3(0.05f, 0.05f, 0.05f)));
 		ourModel.transform(glm::translate(glm::mat4(1.0f), glm::vec3(camera.Position.x, -0.05f, camera.Position.z)));
-		ourModel.Draw(basicShader);
+		renderQueue.submit(ourModel, batchedShader, frustum);
 
-		oldBasicShader.use();
-		setPerFrameUniforms(&oldBasicShader, camera);
 		hammer.resetModelMatrix();
 		hammer.transform(glm::rotate(glm::mat4(1.0f), -1.56f, glm::vec3(1.0f, 0.0f, 0.0f)));
-		hammer.transform(glm::rotate(glm::mat4(1.0f), (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f)));
+		hammer.transform(glm::rotate(glm::mat4(1.0f), currentFrame, glm::vec3(0.0f, 1.0f, 0.0f)));
 		hammer.transform(glm::scale(glm::mat4(1.0f), glm::vec3(0.0015f, 0.0015f, 0.0015f)));
 		hammer.transform(glm::translate(glm::mat4(1.0f), glm::vec3(camera.Position.x, 0.11, camera.Position.z - 0.5)));
-		hammer.Draw(oldBasicShader);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, containerTextureID);
-		moveMoveableObject(movableObjectThatIsNotASimpleFirstPersonCamera);
-		movableObjectThatIsNotASimpleFirstPersonCamera.draw();
-		glBindTexture(GL_TEXTURE_2D, containerTextureID2);
-
-		basicShader.use();
-		setPerFrameUniforms(&basicShader, camera);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, albedoGranite);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, normalGranite);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, metallicGranite);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, roughnessGranite);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, aoGranite);
-
-		for (int i = 0; i < testicles.size(); i++)
-		{
-			if(i % 4 == 0)
-			testicles.at(i).draw();
-		}
+		renderQueue.submit(hammer, oldBasicShader, frustum);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, albedoCopper);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, normalCopper);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, metallicCopper);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, roughnessCopper);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, aoCopper);
-
-		for (int i = 0; i < testicles.size(); i++)
-		{
-			if (i % 4 == 1)
-				testicles.at(i).draw();
-		}
+		movableObjectThatIsNotASimpleFirstPersonCamera.resetModelMatrix();
+		movableObjectThatIsNotASimpleFirstPersonCamera.transform(glm::translate(glm::mat4(1.0f), glm::vec3(frame.movingObjectX, 0.50f, -40.0f)));
+		renderQueue.submit(movableObjectThatIsNotASimpleFirstPersonCamera, frustum);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, albedoTitanium);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, normalTitanium);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, metallicTitanium);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, roughnessTitanium);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, aoTitanium);
-
-		for (int i = 0; i < testicles.size(); i++)
-		{
-			if (i % 4 == 2)
-				testicles.at(i).draw();
-		}
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, albedoPlastic);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, normalPlastic);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, metallicPlastic);
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, roughnessPlastic);
-		glActiveTexture(GL_TEXTURE4);
-		glBindTexture(GL_TEXTURE_2D, aoPlastic);
-
-		for (int i = 0; i < testicles.size(); i++)
-		{
-			if (i % 4 == 3)
-				testicles.at(i).draw();
-		}
+		obstacleInstances.clear();
+		level.forEachObstacle(camera.Position.z - FAR_PLANE, camera.Position.z + 1.0f, [&](float x, const ObstacleSpan &span, unsigned int type) {
+			glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, (span.zMin + span.zMax) * 0.5f));
+			model = glm::scale(model, glm::vec3(1.0f, 1.0f, span.zMax - span.zMin));
+			obstacleInstances.push_back({ model, (GLuint)obstacleMaterials[type % 4] });
+		});
+		obstacles.setInstances(obstacleInstances);
+		renderQueue.submit(obstacles, frustum);
 
 		showcase.resetModelMatrix();
-		showcase.transform(glm::rotate(glm::mat4(1.0f), (float)glfwGetTime(), glm::vec3(1.0f, 0.0f, 0.0f)));
-		showcase.transform(glm::rotate(glm::mat4(1.0f), (float)glfwGetTime(), glm::vec3(0.0f, 1.0f, 0.0f)));
-		showcase.transform(glm::rotate(glm::mat4(1.0f), (float)glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f)));
+		showcase.transform(glm::rotate(glm::mat4(1.0f), currentFrame, glm::vec3(1.0f, 0.0f, 0.0f)));
+		showcase.transform(glm::rotate(glm::mat4(1.0f), currentFrame, glm::vec3(0.0f, 1.0f, 0.0f)));
+		showcase.transform(glm::rotate(glm::mat4(1.0f), currentFrame, glm::vec3(0.0f, 0.0f, 1.0f)));
 		showcase.transform(glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, 0)));
-		if (room) {
-			showcase.draw();
+		if (frame.room) {
+			renderQueue.submit(showcase, frustum);
 		}
 		
 
-		glm::vec3 pos = glm::vec3(0, 0.2 , +5);
-		basicShader.setVec3("lightPositions[0]", pos);
-		basicShader.setVec3("lightColors[0]", glm::vec3(150.0f, 150.0f, 150.0f));
-
-		//pos = glm::vec3(0, 0.4, 0);
-		//basicShader.setVec3("lightPositions[1]", pos);
-		//basicShader.setVec3("lightColors[1]", glm::vec3(150.0f, 150.0f, 150.0f));
-
-		//pos = glm::vec3(0, 0.6, 0);
-		//basicShader.setVec3("lightPositions[2]", pos);
-		//basicShader.setVec3("lightColors[2]", glm::vec3(150.0f, 150.0f, 150.0f));
-
-		pos = glm::vec3(-0.2, 2, camera.Position.z  + 3);
-		basicShader.setVec3("lightPositions[3]", pos);
-		basicShader.setVec3("lightColors[3]", glm::vec3(150.0f, 150.0f, 150.0f));
-
-
 		// draw lanes
-		glBindTexture(GL_TEXTURE_2D, laneTexture);
-		lane1.draw();
-		lane2.draw();
-		lane3.draw();
-		lane4.draw();
-		lane5.draw();
+		renderQueue.submit(lane1, frustum);
+		renderQueue.submit(lane2, frustum);
+		renderQueue.submit(lane3, frustum);
+		renderQueue.submit(lane4, frustum);
+		renderQueue.submit(lane5, frustum);
+
+		// the lanes of the same mesh and material become one instanced draw
+		renderQueue.flush();
 
 		// ich mag plkanes
 		planesWalker.use();
-		setPerFrameUniforms(&planesWalker, camera);
-		planesWalker.setFloat("u_time", glfwGetTime());
-		
-		// lights camera action
-		planesWalker.setVec3("dirL.color", dirL.color);
-		planesWalker.setVec3("dirL.direction", dirL.direction);
-		planesWalker.setVec3("pointL.color", pointL.color);
-		planesWalker.setVec3("pointL.position", pointL.position);
-		planesWalker.setVec3("pointL.attenuation", pointL.attenuation);
-
+		plane.update(camera.Position.z);
 		plane.draw();
 
-		//GLfloat heightMap[width * height] = {};
-		//for (int row = 0; row < height; row++) {
-		//	for (int col = 0; col < width; col++) {
-		//		int realPos = width * row + col;
-		//		glm::vec2 pos = glm::vec2(col / 10, row / 10);
-
-
-		//		float DF = 0.0;
-		//		// Add a random position
-		//		float a = 0.0;
-		//		glm::vec2 vel = glm::vec2(glfwGetTime()*.1);
-		//		DF += snoise(glm::vec2(pos) + vel)*.25 + .25;
-
-		//		// Add a random position
-		//		a = snoise(glm::vec2(pos) * glm::vec2(cos(glfwGetTime()*0.15), sin(glfwGetTime()*0.1)) * glm::vec2(0.1))*3.1415;
-		//		vel = glm::vec2(cos(a), sin(a));
-		//		DF += snoise(glm::vec2(pos) + vel)*.25 + .25;
-
-		//		float pos_z = glm::smoothstep(.7f, .75f, glm::fract(DF));
-
-		//		heightMap[realPos] = pos_z;
-		//	}
-		//}
-
+		// sky last, at the far plane, so only pixels nothing else covered run the noise
 		himmerlblau.use();
-		setPerFrameUniforms(&himmerlblau, camera);
-		himmerlblau.setFloat("u_time", glfwGetTime());
-
-		himmerlblau.setVec3("sky_color", bgColor);
+		glState.depthFunc(GL_LEQUAL);
+		glState.depthMask(GL_FALSE);
 		sky.draw();
+		glState.depthMask(GL_TRUE);
+		glState.depthFunc(GL_LESS);
+
+		if (benchmark.enabled()) {
+			benchmark.endFrame();
+			if (benchmark.finished())
+				glfwSetWindowShouldClose(window, true);
+		}
 
 		glfwSwapBuffers(window);
-		glfwPollEvents();
+		framePacer.endFrame(frame.appliedInput);
 	}
 
+	simulation.stop();
+	if (benchmark.enabled())
+		benchmark.writeResults();
+	framePacer.release();
+
 	glfwTerminate();
 	return 0;
 }
 
-void setPerFrameUniforms(Shader* shader, Camera& camera/*, DirectionalLight& dirL, PointLight& pointL*/)
+// fills the shared uniform block once per frame, every program reads it at the same binding point
+void setPerFrameUniforms(PerFrameUniforms& perFrame, Camera& camera, float time, glm::vec3 skyColor)
 {
-	shader->use();
-	shader->setMat4("viewProjMatrix", glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f) * camera.GetViewMatrix());
-	shader->setVec3("cameraWorldPosition", camera.Position);
-	shader->setFloat("prightness", brightness);
-	//shader->setVec3("viewPos", camera.Position);
-	
+	perFrame.data.viewProjMatrix = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, FAR_PLANE) * camera.GetViewMatrix();
+	perFrame.data.cameraWorldPosition = camera.Position;
+	perFrame.data.brightness = brightness;
+	perFrame.data.skyColor = skyColor;
+	perFrame.data.time = time;
+
+	// light following the runner
+	perFrame.setLight(3, glm::vec3(-0.2, 2, camera.Position.z + 3), glm::vec3(150.0f, 150.0f, 150.0f));
 
-	/*shader->setUniform("dirL.color", dirL.color);
-	shader->setUniform("dirL.direction", dirL.direction);
-	shader->setUniform("pointL.color", pointL.color);
-	shader->setUniform("pointL.position", pointL.position);
-	shader->setUniform("pointL.attenuation", pointL.attenuation);*/
+	perFrame.upload();
 }
 
 float lerp(float a, float b, float f)
@@ -488,41 +440,6 @@ float lerp(float a, float b, float f)
 	return a + f * (b - a);
 }
 
-glm::vec3 mod289(glm::vec3 x) { return x - floor(x * glm::vec3((1.0 / 289.0))) * glm::vec3(289.0); }
-glm::vec2 mod289(glm::vec2 x) { return x - floor(x * glm::vec2((1.0 / 289.0))) * glm::vec2(289.0); }
-glm::vec3 permute(glm::vec3 x) { return mod289(((x * glm::vec3(34.0)) + glm::vec3(1.0)) * x); }
-
-float snoise(glm::vec2 v) {
-	const glm::vec4 C = glm::vec4(0.211324865405187,  // (3.0-sqrt(3.0))/6.0
-		0.366025403784439,  // 0.5*(sqrt(3.0)-1.0)
-		-0.577350269189626,  // -1.0 + 2.0 * C.x
-		0.024390243902439); // 1.0 / 41.0
-	glm::vec2 i = floor(v + glm::dot(v, glm::vec2(C.y, C.y)));
-	glm::vec2 x0 = v - i + glm::dot(i, glm::vec2(C.x, C.x));
-	glm::vec2 i1;
-	i1 = (x0.x > x0.y) ? glm::vec2(1.0, 0.0) : glm::vec2(0.0, 1.0);
-	glm::vec4 x12 = glm::vec4(x0.x, x0.y, x0.x, x0.y) + glm::vec4(C.x, C.x, C.z, C.z);
-	x12.x -= i1.x;
-	x12.y -= i1.y;
-	i = mod289(i); // Avoid truncation effects in permutation
-	glm::vec3 p = permute(permute(i.y + glm::vec3(0.0, i1.y, 1.0))
-		+ i.x + glm::vec3(0.0, i1.x, 1.0));
-
-	glm::vec3 m = glm::max(glm::vec3(0.5) - glm::vec3(glm::dot(x0, x0), glm::dot(glm::vec2(x12.x, x12.y), glm::vec2(x12.x, x12.y)), glm::dot(glm::vec2(x12.z, x12.w), glm::vec2(x12.z, x12.w))), glm::vec3(0.0));
-	m = m * m;
-	m = m * m;
-	glm::vec3 x = glm::vec3(2.0) * glm::fract(p * glm::vec3(C.w) - glm::vec3(1.0));
-	glm::vec3 h = abs(x) - glm::vec3(0.5);
-	glm::vec3 ox = floor(x + glm::vec3(0.5));
-	glm::vec3 a0 = x - ox;
-	m *= glm::vec3(1.79284291400159) - glm::vec3(0.85373472095314) * (a0*a0 + h * h);
-	glm::vec3 g;
-	g.x = a0.x  * x0.x + h.x  * x0.y;
-	g.y = a0.y * x12.x + h.y * x12.y;
-	g.z = a0.z * x12.z + h.z * x12.w;
-	return 130.0 * dot(m, g);
-}
-
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
 	//Lass mas drinnan auch wenn nix drinnan is!
@@ -570,27 +487,12 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		break;
 	case GLFW_KEY_F8:
 		_wireframe = !_wireframe;
-		glPolygonMode(GL_FRONT_AND_BACK, _wireframe ? GL_LINE : GL_FILL);
+		glState.polygonMode(_wireframe ? GL_LINE : GL_FILL);
 		break;
 	case GLFW_KEY_F2:
 		_culling = !_culling;
-		if (_culling) glEnable(GL_CULL_FACE);
-		else glDisable(GL_CULL_FACE);
-		break;
-	case GLFW_KEY_LEFT_SHIFT:
-		camera.MovementSpeed += 1.0f;
-		break;
-	case GLFW_KEY_W:
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-		break;
-	case GLFW_KEY_S:
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-		break;
-	case GLFW_KEY_A:
-		camera.ProcessKeyboard(LEFT, deltaTime);
-		break;
-	case GLFW_KEY_D:
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		if (_culling) glState.enable(GL_CULL_FACE);
+		else glState.disable(GL_CULL_FACE);
 		break;
 	case GLFW_KEY_RIGHT_BRACKET:
 		brightness += 0.5;
@@ -601,20 +503,11 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		brightness -= 0.5;
 		std::cout << brightness << std::endl;
 		break;
-	case GLFW_KEY_SPACE:
-		pause = !pause;
-		break;
-	case GLFW_KEY_PRINT_SCREEN:
-		camera.ProcessKeyboard(RESET, deltaTime);
-		pause = true;
-		room = !room;
-		break;
-	case GLFW_KEY_R:
-		level.coutner = 0;
-		life = 196;
-		pause = true;
-		room = false;
-		camera.ProcessKeyboard(RESET, deltaTime);
+	default:
+		// movement, pause, reset and the showcase room are game logic, applied at the time the key was polled
+		Simulation* simulation = static_cast<Simulation*>(glfwGetWindowUserPointer(window));
+		framePacer.input();
+		simulation->post({ simulation->clock(), key });
 		break;
 	}
 
@@ -627,64 +520,7 @@ void teleportRoom() {
 // make windows resizesable
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
-}
-
-// utility function for moving the moveable object
-void moveMoveableObject(Geometry& obj) {
-
-	if (movingObjPos >= 20.0f)
-	{
-		temp = -1;
-	}
-	else if (movingObjPos <= -20.0f)
-	{
-		temp = 1;
-	}
-
-	movingObjPos += temp * 0.1f;
-	//std::cout << movingObjPos << std::endl;
-	//std::cout << temp << std::endl;
-	obj.transform(glm::translate(glm::mat4(1.0f), glm::vec3(0.01f * temp * deltaTime * 60.0f, 0.0f, 0.0f)));
-}
-
-// utility function for loading a 2D texture from file
-unsigned int loadTexture(char const * path)
-{
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << ".txt" << std::endl;
-		stbi_image_free(data);
-	}
-
-	// Aspirin 500mg ohne Mwst.
-	return textureID;
+	glState.viewport(0, 0, width, height);
 }
 
 static void APIENTRY DebugCallbackDefault(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const GLvoid* userParam) {
@@ -0,0 +1,160 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX 1
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <cstddef>
+#include <cstdio>
+
+/*!
+ * Read-only memory mapping of a whole file
+ * The operating system pages the file in when it is first accessed, so opening is constant time
+ * regardless of the file size and untouched parts are never read from disk
+ */
+class MappedFile
+{
+protected:
+	const char* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	HANDLE _file;
+	HANDLE _mapping;
+#endif
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/*!
+	 * Maps a file, closes the previously mapped file
+	 * @param path: path of the file
+	 * @return whether the file could be mapped
+	 */
+	bool open(const char* path);
+
+	/*!
+	 * Unmaps the file
+	 */
+	void close();
+
+	/*!
+	 * @return the start of the mapped file, nullptr if no file is mapped
+	 */
+	const char* data() const;
+
+	/*!
+	 * @return the size of the mapped file in bytes
+	 */
+	size_t size() const;
+};
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(NULL)
+{
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	_size = (size_t)size.QuadPart;
+
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping != NULL)
+		_data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (_data == nullptr) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (_data != nullptr) UnmapViewOfFile(_data);
+	if (_mapping != NULL) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+
+	_data = nullptr;
+	_size = 0;
+	_mapping = NULL;
+	_file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: _data(nullptr), _size(0)
+{
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	FILE* file = std::fopen(path, "rb");
+	if (file == nullptr) return false;
+
+	// the mapping keeps its own reference to the file, so the file can be closed right away
+	struct stat info;
+	if (fstat(fileno(file), &info) == 0 && info.st_size > 0) {
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+		if (data != MAP_FAILED) {
+			_data = (const char*)data;
+			_size = (size_t)info.st_size;
+		}
+	}
+	std::fclose(file);
+
+	return _data != nullptr;
+}
+
+void MappedFile::close()
+{
+	if (_data != nullptr) munmap((void*)_data, _size);
+
+	_data = nullptr;
+	_size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+const char* MappedFile::data() const
+{
+	return _data;
+}
+
+size_t MappedFile::size() const
+{
+	return _size;
+}
@@ -33,6 +33,13 @@ protected:
 	 */
 	float _alpha;
 
+	/*!
+	 * Uniform handles of the shader, resolved once at creation
+	 */
+	Uniform<glm::vec3> _colorUniform;
+	Uniform<glm::vec3> _materialCoefficientsUniform;
+	Uniform<float> _alphaUniform;
+
 public:
 	/*!
 	 * Base material constructor
@@ -63,6 +70,9 @@ public:
 Material::Material(Shader* shader, glm::vec3 color, glm::vec3 materialCoefficients, float alpha)
 	: _shader(shader), _color(color), _materialCoefficients(materialCoefficients), _alpha(alpha)
 {
+	_colorUniform = _shader->getUniform<glm::vec3>("diffuseColor");
+	_materialCoefficientsUniform = _shader->getUniform<glm::vec3>("materialCoefficients");
+	_alphaUniform = _shader->getUniform<float>("specularAlpha");
 }
 
 Material::~Material()
@@ -76,7 +86,60 @@ Shader* Material::getShader()
 
 void Material::setUniforms()
 {
-	_shader->setVec3("diffuseColor", _color);
-	_shader->setVec3("materialCoefficients", _materialCoefficients);
-	_shader->setFloat("specularAlpha", _alpha);
+	_shader->set(_colorUniform, _color);
+	_shader->set(_materialCoefficientsUniform, _materialCoefficients);
+	_shader->set(_alphaUniform, _alpha);
+}
+
+/*!
+ * Material that samples its textures from the material palette
+ */
+class PbrMaterial : public Material
+{
+protected:
+	/*!
+	 * Index of the material in the palette
+	 */
+	GLint _materialIndex;
+
+	Uniform<int> _materialIndexUniform;
+
+public:
+	/*!
+	 * PBR palette material constructor
+	 * @param shader: The shader used for rendering this material
+	 * @param materialIndex: Index of the material in the palette, -1 samples the sampler2D maps instead
+	 */
+	PbrMaterial(Shader* shader, GLint materialIndex);
+
+	/*!
+	 * @return the index of the material in the palette
+	 */
+	GLint getMaterialIndex() const;
+
+	/*!
+	 * Sets this material's parameters as uniforms in the shader
+	 */
+	virtual void setUniforms();
+};
+
+/* --------------------------------------------- */
+// PBR palette material
+/* --------------------------------------------- */
+
+PbrMaterial::PbrMaterial(Shader* shader, GLint materialIndex)
+	: Material(shader, glm::vec3(1.0f), glm::vec3(1.0f), 1.0f), _materialIndex(materialIndex)
+{
+	_materialIndexUniform = _shader->getUniform<int>("materialIndex");
+}
+
+GLint PbrMaterial::getMaterialIndex() const
+{
+	return _materialIndex;
+}
+
+void PbrMaterial::setUniforms()
+{
+	Material::setUniforms();
+	_shader->set(_materialIndexUniform, _materialIndex);
 }
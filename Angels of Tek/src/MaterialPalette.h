@@ -0,0 +1,154 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+#include "TextureArray.h"
+#include "TextureLoader.h"
+
+/*!
+ * Image files of one PBR material, one per channel
+ * Occlusion, roughness and metallic are packed into one texture when the material is added
+ */
+struct PbrTextureSet {
+	std::string albedo;
+	std::string normal;
+	std::string metallic;
+	std::string roughness;
+	std::string ao;
+};
+
+/*!
+ * All PBR materials of the level, stored as three texture arrays: albedo, normal and ORM, which packs
+ * occlusion, roughness and metallic into red, green and blue
+ * A material is selected in the shader by its index into the arrays, so the arrays are bound once
+ * per frame and any number of materials can be drawn without rebinding textures
+ * The arrays are block-compressed: albedo and ORM as BC1, normals as BC5 with only x and y
+ */
+class MaterialPalette
+{
+protected:
+	TextureArray _albedo;
+	TextureArray _normal;
+	TextureArray _orm;
+
+	/*!
+	 * Loader the images are decoded and uploaded by, nullptr loads them right away
+	 */
+	TextureLoader* _loader;
+
+	/*!
+	 * Number of materials added so far
+	 */
+	GLsizei _count;
+
+	/*!
+	 * Loads an image into a layer of one of the arrays
+	 */
+	void loadLayer(TextureArray& array, GLsizei layer, const std::string& path);
+	void loadLayer(TextureArray& array, GLsizei layer, const std::vector<std::string>& channelPaths);
+
+public:
+	/*!
+	 * First of the three texture units the arrays are bound to, units below are left to sampler2D textures
+	 */
+	static const GLuint FIRST_UNIT = 5;
+
+	/*!
+	 * Material palette constructor
+	 * Until its images are loaded a material is a neutral grey, flat, rough dielectric
+	 * @param size: width and height of every layer, images of a different size are resampled
+	 * @param capacity: maximum number of materials
+	 * @param loader: loader that decodes and uploads the images in the background, nullptr loads them in add()
+	 */
+	MaterialPalette(GLsizei size, GLsizei capacity, TextureLoader* loader = nullptr);
+
+	/*!
+	 * Loads a material into the next free layer of the arrays
+	 * Layers without an image file keep the placeholder, ORM needs all three of its images
+	 * @param textures: image files of the material
+	 * @return index of the material in the shader
+	 */
+	GLint add(const PbrTextureSet& textures);
+
+	/*!
+	 * Builds the mip chains, call once after all materials are added
+	 * Images of the loader come with their own mip chain, so this does nothing if there is a loader
+	 */
+	void finish();
+
+	/*!
+	 * Points the array samplers of a shader (albedoArray, normalArray, ormArray) to the units of the palette
+	 * @param shader: the shader, has to be in use
+	 */
+	void setSamplers(const Shader& shader) const;
+
+	/*!
+	 * Binds all arrays to their texture units
+	 */
+	void bind() const;
+};
+
+MaterialPalette::MaterialPalette(GLsizei size, GLsizei capacity, TextureLoader* loader)
+	: _albedo(size, size, capacity, 3, glm::u8vec4(128), true), _normal(size, size, capacity, 2, glm::u8vec4(128), true),
+	_orm(size, size, capacity, 3, glm::u8vec4(255, 255, 0, 255), true),
+	_loader(loader), _count(0)
+{
+}
+
+void MaterialPalette::loadLayer(TextureArray& array, GLsizei layer, const std::string& path)
+{
+	if (_loader != nullptr)
+		_loader->loadLayer(array, layer, path);
+	else
+		array.loadLayer(layer, path.c_str());
+}
+
+void MaterialPalette::loadLayer(TextureArray& array, GLsizei layer, const std::vector<std::string>& channelPaths)
+{
+	if (_loader != nullptr)
+		_loader->loadLayer(array, layer, channelPaths);
+	else
+		array.loadLayer(layer, channelPaths);
+}
+
+GLint MaterialPalette::add(const PbrTextureSet& textures)
+{
+	if (_count >= _albedo.layers()) {
+		std::cout << "ERROR::MATERIAL_PALETTE::FULL " << textures.albedo << std::endl;
+		return -1;
+	}
+
+	if (!textures.albedo.empty())
+		loadLayer(_albedo, _count, textures.albedo);
+	if (!textures.normal.empty())
+		loadLayer(_normal, _count, textures.normal);
+	if (!textures.ao.empty() && !textures.roughness.empty() && !textures.metallic.empty())
+		loadLayer(_orm, _count, { textures.ao, textures.roughness, textures.metallic });
+
+	return _count++;
+}
+
+void MaterialPalette::finish()
+{
+	if (_loader != nullptr) return;
+
+	_albedo.generateMipmaps();
+	_normal.generateMipmaps();
+	_orm.generateMipmaps();
+}
+
+void MaterialPalette::setSamplers(const Shader& shader) const
+{
+	shader.setInt("albedoArray", FIRST_UNIT);
+	shader.setInt("normalArray", FIRST_UNIT + 1);
+	shader.setInt("ormArray", FIRST_UNIT + 2);
+}
+
+void MaterialPalette::bind() const
+{
+	_albedo.bind(FIRST_UNIT);
+	_normal.bind(FIRST_UNIT + 1);
+	_orm.bind(FIRST_UNIT + 2);
+}
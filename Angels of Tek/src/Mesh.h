@@ -5,9 +5,15 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "Shader.h"
+#include "RenderStats.h"
+#include "GLState.h"
+#include "AABB.h"
 
+#include <cmath>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -28,68 +34,213 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
+// compressed vertex of 20 bytes instead of 56, decoded in vertexQuantization.glsl
+struct QuantizedVertex {
+	// position as unsigned normalized 16 bit within the bounds of the mesh,
+	// w is the handedness of the bitangent: 0 for -1, 65535 for +1
+	uint16_t Position[4];
+	// octahedral normal and tangent as signed normalized 16 bit, the bitangent is cross(normal, tangent) * handedness
+	int16_t Normal[2];
+	int16_t Tangent[2];
+	// texCoords as half floats
+	uint16_t TexCoords[2];
+};
+
+static_assert(sizeof(QuantizedVertex) == 20, "quantized vertex has to be 20 bytes");
+
+enum class VertexFormat : uint32_t {
+	FULL,
+	QUANTIZED
+};
+
+// maps a unit vector onto the octahedron and unfolds it into the [-1, 1] square
+glm::vec2 octahedralEncode(glm::vec3 v)
+{
+	float sum = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+	if (sum <= 0.0f)
+		return glm::vec2(0.0f);
+	v /= sum;
+	glm::vec2 p(v.x, v.y);
+	// the lower half folds over the diagonals
+	if (v.z < 0.0f)
+		p = (1.0f - glm::abs(glm::vec2(v.y, v.x))) * glm::vec2(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+	return p;
+}
+
+QuantizedVertex quantizeVertex(const Vertex &vertex, const AABB &bounds)
+{
+	QuantizedVertex quantized;
+	glm::vec3 extent = bounds.max - bounds.min;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float t = extent[axis] > 0.0f ? (vertex.Position[axis] - bounds.min[axis]) / extent[axis] : 0.0f;
+		quantized.Position[axis] = (uint16_t)std::round(glm::clamp(t, 0.0f, 1.0f) * 65535.0f);
+	}
+	bool rightHanded = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) >= 0.0f;
+	quantized.Position[3] = rightHanded ? 65535 : 0;
+
+	glm::vec2 normal = octahedralEncode(vertex.Normal);
+	glm::vec2 tangent = octahedralEncode(vertex.Tangent);
+	for (int i = 0; i < 2; i++)
+	{
+		quantized.Normal[i] = (int16_t)glm::packSnorm1x16(normal[i]);
+		quantized.Tangent[i] = (int16_t)glm::packSnorm1x16(tangent[i]);
+		quantized.TexCoords[i] = glm::packHalf1x16(vertex.TexCoords[i]);
+	}
+	return quantized;
+}
+
+// sets the attribute pointers of the bound VAO for the vertices in the bound GL_ARRAY_BUFFER
+void setupVertexAttributes(VertexFormat format)
+{
+	if (format == VertexFormat::QUANTIZED)
+	{
+		// the shader gets positions in [0, 1], octahedral normal and tangent in [-1, 1] and the texCoords as they were
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, TexCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), (void*)offsetof(QuantizedVertex, Tangent));
+		return;
+	}
+
+	// set the vertex attribute pointers
+	// vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+	// vertex normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	// vertex texture coords
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	// vertex tangent
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	// vertex bitangent
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+}
+
+// what a mesh texture is used for, every role has a fixed texture unit and sampler
+enum class TextureRole : uint32_t {
+	DIFFUSE,
+	SPECULAR,
+	NORMAL,
+	HEIGHT,
+	COUNT
+};
+
+struct TextureRoleInfo {
+	// type name of the model loader and the model cache
+	const char *typeName;
+	// sampler of the role in the model shaders, nullptr if none of them samples it
+	const char *sampler;
+	// unit the texture is bound to, albedoMap and normalMap use the same ones for other geometry
+	GLuint unit;
+};
+
+static const TextureRoleInfo TEXTURE_ROLES[(size_t)TextureRole::COUNT] = {
+	{ "texture_diffuse", "albedoMap", 0 },
+	{ "texture_specular", nullptr, 0 },
+	{ "texture_normal", "normalMap", 1 },
+	{ "texture_height", nullptr, 0 },
+};
+
+// role of a type name of the model loader, unknown names are treated as diffuse
+TextureRole textureRole(const string &typeName)
+{
+	for (size_t i = 0; i < (size_t)TextureRole::COUNT; i++)
+		if (typeName == TEXTURE_ROLES[i].typeName)
+			return (TextureRole)i;
+	return TextureRole::DIFFUSE;
+}
+
 struct Texture {
 	unsigned int id;
-	string type;
+	TextureRole role;
 	string path;
 };
 
+// the textures a program samples and its uniform locations, resolved on the first draw of a mesh with the program
+struct MeshBinding {
+	GLuint program;
+	unsigned int textureCount;
+	GLuint units[(size_t)TextureRole::COUNT];
+	GLuint textures[(size_t)TextureRole::COUNT];
+	Uniform<bool> quantizedVertex;
+	Uniform<glm::vec3> positionOffset;
+	Uniform<glm::vec3> positionScale;
+};
+
 class Mesh {
 public:
 	/*  Mesh Data  */
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
+	// the vertices and indices only live on the GPU, the draw needs nothing but their count and type
+	unsigned int indexCount;
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	GLenum indexType;
+	VertexFormat format;
 	vector<Texture> textures;
 	unsigned int VAO;
+	// bounding box of the vertex positions in model space
+	AABB bounds;
 
 	/*  Functions  */
 	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	Mesh(const vector<Vertex> &vertices, const vector<unsigned int> &indices, vector<Texture> textures)
+		: format(VertexFormat::FULL), textures(textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		for (const Vertex &vertex : vertices)
+			bounds.grow(vertex.Position);
 
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
-		setupMesh();
+		setupMesh(vertices.data(), vertices.size(), indices.data(), GL_UNSIGNED_INT, indices.size());
+	}
+
+	// constructor for data that is already in memory, e.g. a mapped model cache, uploaded without copying it first
+	// quantized vertices are relative to the bounds, so these have to be the ones they were quantized with
+	Mesh(const void *vertices, VertexFormat format, size_t vertexCount, const void *indices, GLenum indexType, size_t indexCount, vector<Texture> textures, AABB bounds)
+		: format(format), textures(textures), bounds(bounds)
+	{
+		setupMesh(vertices, vertexCount, indices, indexType, indexCount);
 	}
 
 	// render the mesh
-	void Draw(Shader shader)
+	void Draw(const Shader &shader)
 	{
-		// bind appropriate textures
-		unsigned int diffuseNr = 1;
-		unsigned int specularNr = 1;
-		unsigned int normalNr = 1;
-		unsigned int heightNr = 1;
-		for (unsigned int i = 0; i < textures.size(); i++)
+		const MeshBinding &binding = resolveBinding(shader);
+
+		// bind the textures the program samples to the units of their roles
+		for (unsigned int i = 0; i < binding.textureCount; i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-			// retrieve texture number (the N in diffuse_textureN)
-			string number;
-			string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++); // transfer unsigned int to stream
-			else if (name == "texture_normal")
-				number = std::to_string(normalNr++); // transfer unsigned int to stream
-			else if (name == "texture_height")
-				number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-													 // now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-			// and finally bind the texture
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+			glState.bindTexture(binding.units[i], GL_TEXTURE_2D, binding.textures[i]);
+		}
+
+		// quantized positions are scaled back into the bounds in the vertex shader
+		bool quantized = format == VertexFormat::QUANTIZED;
+		if (quantized)
+		{
+			shader.set(binding.quantizedVertex, true);
+			shader.set(binding.positionOffset, bounds.min);
+			shader.set(binding.positionScale, bounds.max - bounds.min);
 		}
 
 		// draw mesh
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		glState.bindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+		renderStats.drawCalls++;
 
-		// always good practice to set everything back to defaults once configured.
-		glActiveTexture(GL_TEXTURE0);
+		// other geometry drawn with the same shader uses full floats
+		if (quantized)
+		{
+			shader.set(binding.quantizedVertex, false);
+			shader.set(binding.positionOffset, glm::vec3(0.0f));
+			shader.set(binding.positionScale, glm::vec3(1.0f));
+		}
 	}
 
 	//// render the mesh
@@ -133,45 +284,76 @@ public:
 private:
 	/*  Render data  */
 	unsigned int VBO, EBO;
+	// one binding per program the mesh was drawn with, usually one or two
+	vector<MeshBinding> bindings;
 
 	/*  Functions    */
+	// finds the binding of the program, or resolves it once: the first texture of every role the program
+	// samples is bound to the unit of the role, and the sampler is pointed to that unit
+	const MeshBinding &resolveBinding(const Shader &shader)
+	{
+		for (const MeshBinding &binding : bindings)
+			if (binding.program == shader.ID)
+				return binding;
+
+		// the uniforms start at -1, only the first textureCount units and textures are read
+		MeshBinding binding;
+		binding.program = shader.ID;
+		binding.textureCount = 0;
+		bool bound[(size_t)TextureRole::COUNT] = {};
+		for (const Texture &texture : textures)
+		{
+			const TextureRoleInfo &role = TEXTURE_ROLES[(size_t)texture.role];
+			if (bound[(size_t)texture.role] || role.sampler == nullptr)
+				continue;
+			GLint sampler = shader.findUniformLocation(role.sampler);
+			if (sampler == -1)
+				continue;
+
+			// the units only depend on the role, so every mesh sets the sampler to the same value
+			glUniform1i(sampler, (GLint)role.unit);
+			bound[(size_t)texture.role] = true;
+			binding.units[binding.textureCount] = role.unit;
+			binding.textures[binding.textureCount] = texture.id;
+			binding.textureCount++;
+		}
+		if (format == VertexFormat::QUANTIZED)
+		{
+			binding.quantizedVertex = shader.getUniform<bool>("quantizedVertex");
+			binding.positionOffset = shader.getUniform<glm::vec3>("positionOffset");
+			binding.positionScale = shader.getUniform<glm::vec3>("positionScale");
+		}
+		bindings.push_back(binding);
+		return bindings.back();
+	}
+
 	// initializes all the buffer objects/arrays
-	void setupMesh()
+	void setupMesh(const void *vertices, size_t vertexCount, const void *indices, GLenum indexType, size_t indexCount)
 	{
+		this->indexCount = (unsigned int)indexCount;
+		this->indexType = indexType;
+
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
 		glGenBuffers(1, &EBO);
 
-		glBindVertexArray(VAO);
+		glState.bindVertexArray(VAO);
 		// load data into vertex buffers
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
 		// A great thing about structs is that their memory layout is sequential for all its items.
 		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
 		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		size_t vertexSize = format == VertexFormat::QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexSize, vertices, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, indices, GL_STATIC_DRAW);
 
-		// set the vertex attribute pointers
-		// vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		setupVertexAttributes(format);
 
-		glBindVertexArray(0);
+		glState.bindVertexArray(0);
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "Mesh.h"
+
+/*!
+ * Effect of MeshOptimizer::optimize() on one or more meshes
+ */
+struct MeshOptimizerStatistics {
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	size_t triangles = 0;
+
+	/*!
+	 * Simulated post-transform cache misses of the original and the optimized index order
+	 */
+	size_t missesBefore = 0;
+	size_t missesAfter = 0;
+
+	/*!
+	 * @return average cache miss ratio, the number of vertices transformed per triangle, before the optimization
+	 */
+	float acmrBefore() const;
+
+	/*!
+	 * @return average cache miss ratio after the optimization, between 0.5 for a perfect grid and 3
+	 */
+	float acmrAfter() const;
+
+	void add(const MeshOptimizerStatistics& other);
+};
+
+/*!
+ * Import-time optimization of indexed triangle meshes for the vertex pipeline of the GPU:
+ * duplicate vertices are welded, triangles are reordered so their vertices hit the post-transform
+ * cache (Forsyth's linear-speed algorithm) and vertices are reordered by first use so the vertex
+ * fetch reads memory front to back.
+ */
+class MeshOptimizer
+{
+protected:
+	/*!
+	 * Size of the LRU cache the triangle order is optimized for
+	 */
+	static const int CACHE_SIZE = 32;
+
+	static float vertexScore(int cachePosition, int remainingTriangles);
+
+	/*!
+	 * Merges vertices whose attributes are bitwise equal and rewrites the indices
+	 */
+	static void weld(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	/*!
+	 * Reorders the triangles for the post-transform vertex cache
+	 */
+	static void reorderTriangles(std::vector<unsigned int>& indices, size_t vertexCount);
+
+	/*!
+	 * Renumbers the vertices in the order the indices first use them, unused vertices are dropped
+	 */
+	static void reorderVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+public:
+	/*!
+	 * Size of the FIFO cache the miss ratio is measured with, typical of GPUs with a post-transform cache
+	 */
+	static const int SIMULATED_CACHE_SIZE = 16;
+
+	/*!
+	 * Welds, reorders the triangles and then the vertices of a mesh
+	 * @param vertices: the vertices, replaced by the optimized ones
+	 * @param indices: the triangle list, replaced by the optimized one
+	 * @return the vertex counts and cache misses before and after
+	 */
+	static MeshOptimizerStatistics optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	/*!
+	 * Counts the vertices a FIFO post-transform cache has to transform for a triangle list
+	 * @param indices: the triangle list
+	 * @param cacheSize: number of entries of the cache
+	 * @return the number of cache misses
+	 */
+	static size_t simulateCacheMisses(const std::vector<unsigned int>& indices, int cacheSize = SIMULATED_CACHE_SIZE);
+};
+
+float MeshOptimizerStatistics::acmrBefore() const
+{
+	return triangles > 0 ? (float)missesBefore / triangles : 0.0f;
+}
+
+float MeshOptimizerStatistics::acmrAfter() const
+{
+	return triangles > 0 ? (float)missesAfter / triangles : 0.0f;
+}
+
+void MeshOptimizerStatistics::add(const MeshOptimizerStatistics& other)
+{
+	verticesBefore += other.verticesBefore;
+	verticesAfter += other.verticesAfter;
+	triangles += other.triangles;
+	missesBefore += other.missesBefore;
+	missesAfter += other.missesAfter;
+}
+
+MeshOptimizerStatistics MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	MeshOptimizerStatistics statistics;
+	statistics.verticesBefore = vertices.size();
+	statistics.triangles = indices.size() / 3;
+	statistics.missesBefore = simulateCacheMisses(indices);
+
+	weld(vertices, indices);
+	reorderTriangles(indices, vertices.size());
+	reorderVertices(vertices, indices);
+
+	statistics.verticesAfter = vertices.size();
+	statistics.missesAfter = simulateCacheMisses(indices);
+	return statistics;
+}
+
+size_t MeshOptimizer::simulateCacheMisses(const std::vector<unsigned int>& indices, int cacheSize)
+{
+	std::vector<unsigned int> cache(cacheSize, UINT32_MAX);
+	size_t next = 0, misses = 0;
+	for (unsigned int index : indices) {
+		if (std::find(cache.begin(), cache.end(), index) != cache.end()) continue;
+		cache[next] = index;
+		next = (next + 1) % cacheSize;
+		misses++;
+	}
+	return misses;
+}
+
+void MeshOptimizer::weld(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	// FNV-1a over the bytes, Vertex is all floats without padding so equal bytes mean equal vertices
+	struct Hash {
+		size_t operator()(const Vertex& vertex) const {
+			const unsigned char* bytes = (const unsigned char*)&vertex;
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); i++) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+			return (size_t)hash;
+		}
+	};
+	struct Equal {
+		bool operator()(const Vertex& a, const Vertex& b) const {
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	std::unordered_map<Vertex, unsigned int, Hash, Equal> unique(vertices.size());
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++) {
+		auto inserted = unique.insert(std::make_pair(vertices[i], (unsigned int)welded.size()));
+		if (inserted.second)
+			welded.push_back(vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+
+	for (unsigned int& index : indices)
+		index = remap[index];
+	vertices.swap(welded);
+}
+
+float MeshOptimizer::vertexScore(int cachePosition, int remainingTriangles)
+{
+	if (remainingTriangles == 0) return -1.0f;
+
+	// the vertices of the last triangle get a fixed score, so the next triangle does not just reuse all three
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = std::pow(1.0f - (float)(cachePosition - 3) / (CACHE_SIZE - 3), 1.5f);
+	}
+
+	// vertices with few triangles left are finished first, so they do not stay behind as isolated triangles
+	score += 2.0f / std::sqrt((float)remainingTriangles);
+	return score;
+}
+
+void MeshOptimizer::reorderTriangles(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// triangles of every vertex, the first remaining[v] entries are the ones not emitted yet
+	std::vector<unsigned int> firstTriangle(vertexCount + 1, 0);
+	for (unsigned int index : indices)
+		firstTriangle[index + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] += firstTriangle[v];
+
+	std::vector<int> remaining(vertexCount, 0);
+	std::vector<unsigned int> triangles(indices.size());
+	for (size_t t = 0; t < triangleCount; t++) {
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int v = indices[t * 3 + corner];
+			triangles[firstTriangle[v] + remaining[v]++] = (unsigned int)t;
+		}
+	}
+
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScores[v] = vertexScore(-1, remaining[v]);
+
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> cache, nextCache;
+	cache.reserve(CACHE_SIZE + 3);
+	nextCache.reserve(CACHE_SIZE + 3);
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+
+	size_t scanStart = 0;
+	long best = -1;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		// without a candidate around the cache, continue with the next triangle in the original order
+		if (best < 0) {
+			while (emitted[scanStart]) scanStart++;
+			best = (long)scanStart;
+		}
+
+		const unsigned int* triangle = &indices[best * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[best] = 1;
+
+		// remove the triangle from the lists of its vertices
+		for (int corner = 0; corner < 3; corner++) {
+			unsigned int v = triangle[corner];
+			unsigned int* list = &triangles[firstTriangle[v]];
+			int count = remaining[v];
+			for (int i = 0; i < count; i++) {
+				if (list[i] == (unsigned int)best) {
+					std::swap(list[i], list[count - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// the vertices of the triangle move to the front of the LRU cache
+		nextCache.assign(triangle, triangle + 3);
+		for (unsigned int v : cache) {
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				nextCache.push_back(v);
+		}
+		// evicted vertices lose their cache bonus
+		for (size_t i = CACHE_SIZE; i < nextCache.size(); i++)
+			vertexScores[nextCache[i]] = vertexScore(-1, remaining[nextCache[i]]);
+		if (nextCache.size() > (size_t)CACHE_SIZE)
+			nextCache.resize(CACHE_SIZE);
+		cache.swap(nextCache);
+
+		for (size_t i = 0; i < cache.size(); i++)
+			vertexScores[cache[i]] = vertexScore((int)i, remaining[cache[i]]);
+
+		// only triangles of cached vertices changed their score, the best next triangle is among them
+		best = -1;
+		float bestScore = -1.0f;
+		for (unsigned int v : cache) {
+			const unsigned int* list = &triangles[firstTriangle[v]];
+			for (int i = 0; i < remaining[v]; i++) {
+				unsigned int t = list[i];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (score > bestScore) {
+					bestScore = score;
+					best = (long)t;
+				}
+			}
+		}
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::reorderVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	std::vector<unsigned int> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (unsigned int& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = (unsigned int)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
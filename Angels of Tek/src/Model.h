@@ -11,8 +11,14 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "ModelBatch.h"
+#include "ModelCache.h"
 #include "Shader.h"
+#include "Frustum.h"
+#include "TextureLoader.h"
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -21,11 +27,15 @@
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// loads the texture right away, or queues it on the loader and returns a texture showing the placeholder until it arrives
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, TextureLoader *loader = nullptr, glm::u8vec4 placeholder = glm::u8vec4(255), bool compress = false);
 
 class Model
 {
 public:
+	// changing the flags invalidates the model caches
+	static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
 	/*  Model Data */
 	vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
 	vector<Mesh> meshes;
@@ -35,20 +45,68 @@ public:
 
 	/*  Functions   */
 	// constructor, expects a filepath to a 3D model.
-	Model(string const &path, glm::mat4 _modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)), bool gamma = false) : gammaCorrection(gamma)
+	// the textures are loaded in the background if a loader is given
+	// quantized meshes store 20 instead of 56 bytes per vertex, the shader has to include vertexQuantization.glsl
+	// with a batch the meshes go into its shared buffers instead of their own, in the vertex format of the batch,
+	// and are drawn with pbr_batched.vert; the batch has to be finished before the first draw
+	Model(string const &path, glm::mat4 _modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)), bool gamma = false, TextureLoader *loader = nullptr, bool quantize = false, ModelBatch *batch = nullptr)
+		: gammaCorrection(gamma), loader(loader), batch(batch),
+		vertexFormat(batch ? batch->format() : quantize ? VertexFormat::QUANTIZED : VertexFormat::FULL)
 	{
 		loadModel(path);
 	}
 
 	// draws the model, and thus all its meshes
-	void Draw(Shader shader)
+	void Draw(const Shader &shader)
 	{
-		Shader* temp = &shader;
-		temp->setMat4("modelMatrix", _modelMatrix);
+		if (batch)
+		{
+			for (unsigned int i = 0; i < batchMeshes.size(); i++)
+				batch->queue(batchMeshes[i], _modelMatrix);
+			batch->draw(shader);
+			return;
+		}
+
+		shader.setMat4("modelMatrix", _modelMatrix);
 		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shader);
 	}
 
+	// draws the meshes whose bounding boxes intersect the frustum
+	void Draw(const Shader &shader, const Frustum &frustum)
+	{
+		if (batch)
+		{
+			Queue(frustum);
+			batch->draw(shader);
+			return;
+		}
+
+		meshBounds.clear();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshBounds.push_back(meshes[i].bounds.transform(_modelMatrix));
+		frustum.cull(meshBounds, meshVisible);
+
+		shader.setMat4("modelMatrix", _modelMatrix);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			if (meshVisible[i])
+				meshes[i].Draw(shader);
+	}
+
+	// queues the meshes of a batched model whose bounding boxes intersect the frustum,
+	// so several models of the same batch are drawn together by one ModelBatch::draw
+	void Queue(const Frustum &frustum)
+	{
+		meshBounds.clear();
+		for (unsigned int i = 0; i < batchMeshes.size(); i++)
+			meshBounds.push_back(batch->bounds(batchMeshes[i]).transform(_modelMatrix));
+		frustum.cull(meshBounds, meshVisible);
+
+		for (unsigned int i = 0; i < batchMeshes.size(); i++)
+			if (meshVisible[i])
+				batch->queue(batchMeshes[i], _modelMatrix);
+	}
+
 	void transform(glm::mat4 transformation)
 	{
 		_modelMatrix = transformation * _modelMatrix;
@@ -59,29 +117,84 @@ public:
 		_modelMatrix = glm::mat4(1);
 	}
 
+	// the batch the meshes were added to, nullptr if they have their own buffers
+	ModelBatch *getBatch() const
+	{
+		return batch;
+	}
+
 private:
+	TextureLoader *loader;
+	ModelBatch *batch;
+	VertexFormat vertexFormat;
+	// meshes of the model in the batch
+	vector<GLuint> batchMeshes;
+
+	// per-frame culling data, kept to reuse their memory
+	BoundsSoA meshBounds;
+	vector<unsigned char> meshVisible;
+
 	/*  Functions   */
-	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+	// loads a model from its cache, or with supported ASSIMP extensions from file, and stores the resulting meshes in the meshes vector.
 	void loadModel(string const &path)
 	{
-		// read file via ASSIMP
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-		// check for errors
-		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-		{
-			cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-			return;
-		}
+		auto start = std::chrono::steady_clock::now();
 		// retrieve the directory path of the filepath
 		directory = path.substr(0, path.find_last_of('/'));
 
-		// process ASSIMP's root node recursively
-		processNode(scene->mRootNode, scene);
+		// the cache is mapped and its vertices and indices are uploaded in place, Assimp only runs if it is missing or outdated
+		ModelCache cache;
+		bool cached = cache.open(ModelCache::cachePath(path), path, IMPORT_FLAGS, vertexFormat);
+		if (!cached)
+		{
+			// read file via ASSIMP
+			Assimp::Importer importer;
+			const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+			// check for errors
+			if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+			{
+				cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+				return;
+			}
+
+			// process ASSIMP's root node recursively
+			vector<ModelCacheSource> sources;
+			processNode(scene->mRootNode, scene, sources);
+
+			// weld and reorder for the post-transform cache and the vertex fetch, the cache keeps the result
+			MeshOptimizerStatistics optimized;
+			for (ModelCacheSource &source : sources)
+				optimized.add(MeshOptimizer::optimize(source.vertices, source.indices));
+			cout << "model " << path << ": " << optimized.verticesBefore << " -> " << optimized.verticesAfter << " vertices, ACMR "
+				<< optimized.acmrBefore() << " -> " << optimized.acmrAfter() << " (" << optimized.triangles << " triangles)" << endl;
+
+			vector<char> image = ModelCache::encode(path, IMPORT_FLAGS, vertexFormat, sources);
+			if (!ModelCache::write(ModelCache::cachePath(path), image))
+				cout << "ERROR::MODEL::CACHE_NOT_WRITTEN " << ModelCache::cachePath(path) << endl;
+			cache.load(std::move(image));
+		}
+
+		for (unsigned int i = 0; i < cache.meshCount(); i++)
+		{
+			if (batch)
+			{
+				batchMeshes.push_back(batch->addMesh(cache.vertices(i), cache.mesh(i).vertexCount, cache.indices(i), cache.indexType(i), cache.mesh(i).indexCount,
+					cache.bounds(i), batchTextures(cache, i)));
+				continue;
+			}
+
+			vector<Texture> textures;
+			for (unsigned int j = 0; j < cache.mesh(i).textureCount; j++)
+				textures.push_back(loadTexture(cache.texturePath(i, j), cache.textureType(i, j)));
+			meshes.push_back(Mesh(cache.vertices(i), cache.vertexFormat(), cache.mesh(i).vertexCount, cache.indices(i), cache.indexType(i), cache.mesh(i).indexCount, textures, cache.bounds(i)));
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		cout << "model " << path << ": " << cache.meshCount() << " meshes in " << ms << " ms" << (cached ? " from the cache" : ", imported") << endl;
 	}
 
 	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void processNode(aiNode *node, const aiScene *scene)
+	void processNode(aiNode *node, const aiScene *scene, vector<ModelCacheSource> &sources)
 	{
 		// process each mesh located at the current node
 		for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -89,22 +202,22 @@ private:
 			// the node object only contains indices to index the actual objects in the scene. 
 			// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
 			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			sources.push_back(processMesh(mesh, scene));
 		}
 		// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
 		for (unsigned int i = 0; i < node->mNumChildren; i++)
 		{
-			processNode(node->mChildren[i], scene);
+			processNode(node->mChildren[i], scene, sources);
 		}
 
 	}
 
-	Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+	ModelCacheSource processMesh(aiMesh *mesh, const aiScene *scene)
 	{
 		// data to fill
-		vector<Vertex> vertices;
-		vector<unsigned int> indices;
-		vector<Texture> textures;
+		ModelCacheSource source;
+		vector<Vertex> &vertices = source.vertices;
+		vector<unsigned int> &indices = source.indices;
 
 		// Walk through each of the mesh's vertices
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -163,62 +276,77 @@ private:
 		// normal: texture_normalN
 
 		// 1. diffuse maps
-		vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+		addMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", source);
 		// 2. specular maps
-		vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+		addMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", source);
 		// 3. normal maps
-		std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
+		addMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", source);
 		// 4. height maps
-		std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+		addMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", source);
 
-		// return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
+		// return the extracted mesh data, the meshes are created from the cache
+		return source;
 	}
 
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+	// records the paths of all material textures of a given type, they are loaded when the meshes are created
+	void addMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, ModelCacheSource &source)
 	{
-		vector<Texture> textures;
 		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-					break;
-				}
-			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-			}
+			source.textures.push_back(make_pair(typeName, string(str.C_Str())));
+		}
+	}
+
+	// the palette textures of a batched mesh, the palette has no slot for specular and height maps
+	PbrTextureSet batchTextures(const ModelCache &cache, unsigned int mesh)
+	{
+		PbrTextureSet textures;
+		for (unsigned int j = 0; j < cache.mesh(mesh).textureCount; j++)
+		{
+			string type = cache.textureType(mesh, j);
+			if (type == "texture_diffuse" && textures.albedo.empty())
+				textures.albedo = directory + '/' + cache.texturePath(mesh, j);
+			else if (type == "texture_normal" && textures.normal.empty())
+				textures.normal = directory + '/' + cache.texturePath(mesh, j);
 		}
 		return textures;
 	}
+
+	// loads a texture if it is not loaded yet.
+	// the required info is returned as a Texture struct.
+	Texture loadTexture(const string &path, const string &typeName)
+	{
+		// check if texture was loaded before and if so, skip loading a new texture
+		for (unsigned int j = 0; j < textures_loaded.size(); j++)
+		{
+			if (textures_loaded[j].path == path)
+				return textures_loaded[j]; // a texture with the same filepath has already been loaded. (optimization)
+		}
+
+		// if texture hasn't been loaded already, load it
+		Texture texture;
+		// normal maps start out flat, everything else white
+		glm::u8vec4 placeholder = typeName == "texture_normal" ? glm::u8vec4(128, 128, 255, 255) : glm::u8vec4(255);
+		// normal maps keep all three channels, the model shader does not reconstruct z
+		texture.id = TextureFromFile(path.c_str(), this->directory, false, loader, placeholder, typeName != "texture_normal");
+		texture.role = textureRole(typeName);
+		texture.path = path;
+		textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+		return texture;
+	}
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, TextureLoader *loader, glm::u8vec4 placeholder, bool compress)
 {
 	string filename = string(path);
 	filename = directory + '/' + filename;
 
+	if (loader)
+		return loader->load2D(filename, placeholder, compress);
+
 	unsigned int textureID;
 	glGenTextures(1, &textureID);
 
@@ -234,7 +362,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 		else if (nrComponents == 4)
 			format = GL_RGBA;
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
+		glState.bindTexture(GL_TEXTURE_2D, textureID);
 		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
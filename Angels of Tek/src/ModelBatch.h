@@ -0,0 +1,330 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AABB.h"
+#include "GLState.h"
+#include "MaterialPalette.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+/*!
+ * Per-draw data of a ModelBatch, read by pbr_batched.vert from a shader storage buffer (std430)
+ */
+struct ModelDrawData {
+	glm::mat4 modelMatrix;
+
+	/*!
+	 * Maps quantized positions into the bounds of the mesh (xyz), identity for full float vertices
+	 */
+	glm::vec4 positionOffset;
+	glm::vec4 positionScale;
+
+	/*!
+	 * Layer of the mesh textures in the material palette
+	 */
+	GLint materialIndex;
+	GLint padding[3];
+};
+
+static_assert(sizeof(ModelDrawData) == 112, "model draw data has to match the std430 layout");
+
+/*!
+ * Command of glMultiDrawElementsIndirect, as defined by OpenGL
+ */
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/*!
+ * Range of a mesh in the shared buffers of a ModelBatch
+ */
+struct ModelBatchMesh {
+	GLuint indexCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLint materialIndex;
+	AABB bounds;
+};
+
+/*!
+ * Meshes of one or more models packed into one vertex and one index buffer, their textures into the layers
+ * of a material palette, so every mesh queued in a frame is drawn with a single glMultiDrawElementsIndirect
+ * Every command draws one instance with its index as base instance, an instanced attribute then gives the
+ * vertex shader the index of its draw (gl_DrawID needs OpenGL 4.6), which selects the model matrix, the
+ * position bounds and the material from the storage buffer
+ */
+class ModelBatch
+{
+protected:
+	VertexFormat _format;
+	MaterialPalette* _palette;
+
+	/*!
+	 * Vertices and indices of all meshes until finish() uploads them
+	 */
+	std::vector<unsigned char> _vertexData;
+	std::vector<uint32_t> _indexData;
+	size_t _vertexCount;
+	size_t _maxMeshVertices;
+
+	std::vector<ModelBatchMesh> _meshes;
+
+	/*!
+	 * Palette layers of the texture sets added so far, meshes with the same textures share a layer
+	 */
+	std::map<std::string, GLint> _materials;
+
+	GLuint _vao;
+	GLuint _vbo;
+	GLuint _ebo;
+	GLenum _indexType;
+
+	/*!
+	 * Buffer of the draw indices 0, 1, 2, ... read at attribute location DRAW_ID_LOCATION
+	 */
+	GLuint _drawIdBuffer;
+	GLsizei _drawIdCapacity;
+
+	GLuint _drawBuffer;
+	GLuint _commandBuffer;
+
+	/*!
+	 * Draws queued for the next draw(), kept to reuse their memory
+	 */
+	std::vector<ModelDrawData> _draws;
+	std::vector<DrawElementsIndirectCommand> _commands;
+
+	GLint material(const PbrTextureSet& textures);
+
+public:
+	/*!
+	 * Binding point of the storage buffer with the ModelDrawData
+	 */
+	static const GLuint DRAW_BINDING = 1;
+
+	/*!
+	 * Attribute location of the draw index, after those of the vertex formats
+	 */
+	static const GLuint DRAW_ID_LOCATION = 8;
+
+	/*!
+	 * Model batch constructor
+	 * @param format: format of the vertices of all meshes
+	 * @param palette: palette the mesh textures are added to, its arrays have to be bound when drawing
+	 */
+	ModelBatch(VertexFormat format, MaterialPalette* palette);
+	~ModelBatch();
+
+	ModelBatch(const ModelBatch&) = delete;
+	ModelBatch& operator=(const ModelBatch&) = delete;
+
+	/*!
+	 * Appends a mesh, call before finish()
+	 * @param vertices: vertices in the format of the batch
+	 * @param vertexCount: number of vertices
+	 * @param indices: triangle list of GL_UNSIGNED_SHORT or GL_UNSIGNED_INT indices
+	 * @param indexType: type of the indices
+	 * @param indexCount: number of indices
+	 * @param bounds: bounds of the vertex positions, quantized positions are relative to them
+	 * @param textures: image files of the mesh, empty ones keep the placeholder of the palette
+	 * @return index of the mesh in the batch
+	 */
+	GLuint addMesh(const void* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+		const AABB& bounds, const PbrTextureSet& textures);
+
+	/*!
+	 * Uploads the meshes into the shared buffers, 16-bit indices if no mesh has more than 65536 vertices
+	 */
+	void finish();
+
+	VertexFormat format() const;
+	const AABB& bounds(GLuint mesh) const;
+
+	/*!
+	 * Queues a mesh for the next draw()
+	 * @param mesh: index of the mesh
+	 * @param modelMatrix: model matrix of the mesh
+	 */
+	void queue(GLuint mesh, const glm::mat4& modelMatrix);
+
+	/*!
+	 * Draws all queued meshes with one draw call and empties the queue
+	 * @param shader: shader reading the draw data, has to be in use
+	 */
+	void draw(const Shader& shader);
+};
+
+ModelBatch::ModelBatch(VertexFormat format, MaterialPalette* palette)
+	: _format(format), _palette(palette), _vertexCount(0), _maxMeshVertices(0), _vao(0), _vbo(0), _ebo(0),
+	_indexType(GL_UNSIGNED_INT), _drawIdBuffer(0), _drawIdCapacity(0), _drawBuffer(0), _commandBuffer(0)
+{
+}
+
+ModelBatch::~ModelBatch()
+{
+	if (_vao == 0) return;
+
+	glState.deleteVertexArray(_vao);
+	GLuint buffers[] = { _vbo, _ebo, _drawIdBuffer, _drawBuffer, _commandBuffer };
+	for (GLuint buffer : buffers)
+		glState.deleteBuffer(buffer);
+}
+
+GLint ModelBatch::material(const PbrTextureSet& textures)
+{
+	std::string key = textures.albedo + '\n' + textures.normal + '\n' + textures.metallic + '\n' + textures.roughness + '\n' + textures.ao;
+	auto found = _materials.find(key);
+	if (found != _materials.end())
+		return found->second;
+
+	GLint index = _palette->add(textures);
+	_materials[key] = index;
+	return index;
+}
+
+GLuint ModelBatch::addMesh(const void* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+	const AABB& bounds, const PbrTextureSet& textures)
+{
+	ModelBatchMesh mesh;
+	mesh.indexCount = (GLuint)indexCount;
+	mesh.firstIndex = (GLuint)_indexData.size();
+	mesh.baseVertex = (GLint)_vertexCount;
+	mesh.materialIndex = material(textures);
+	mesh.bounds = bounds;
+	_meshes.push_back(mesh);
+
+	size_t vertexSize = _format == VertexFormat::QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex);
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	_vertexData.insert(_vertexData.end(), bytes, bytes + vertexCount * vertexSize);
+	_vertexCount += vertexCount;
+	_maxMeshVertices = std::max(_maxMeshVertices, vertexCount);
+
+	// the indices stay relative to the mesh, the commands add the base vertex
+	if (indexType == GL_UNSIGNED_SHORT) {
+		const uint16_t* shortIndices = (const uint16_t*)indices;
+		_indexData.insert(_indexData.end(), shortIndices, shortIndices + indexCount);
+	}
+	else {
+		const uint32_t* intIndices = (const uint32_t*)indices;
+		_indexData.insert(_indexData.end(), intIndices, intIndices + indexCount);
+	}
+
+	return (GLuint)_meshes.size() - 1;
+}
+
+void ModelBatch::finish()
+{
+	glGenVertexArrays(1, &_vao);
+	glGenBuffers(1, &_vbo);
+	glGenBuffers(1, &_ebo);
+	glGenBuffers(1, &_drawIdBuffer);
+	glGenBuffers(1, &_drawBuffer);
+	glGenBuffers(1, &_commandBuffer);
+
+	glState.bindVertexArray(_vao);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, _vertexData.size(), _vertexData.data(), GL_STATIC_DRAW);
+	setupVertexAttributes(_format);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	if (_maxMeshVertices <= 65536) {
+		std::vector<uint16_t> shortIndices(_indexData.begin(), _indexData.end());
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+		_indexType = GL_UNSIGNED_SHORT;
+	}
+	else {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indexData.size() * sizeof(uint32_t), _indexData.data(), GL_STATIC_DRAW);
+		_indexType = GL_UNSIGNED_INT;
+	}
+
+	// one value per instance, the base instance of a command selects its draw index
+	glState.bindBuffer(GL_ARRAY_BUFFER, _drawIdBuffer);
+	glEnableVertexAttribArray(DRAW_ID_LOCATION);
+	glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+	glVertexAttribDivisor(DRAW_ID_LOCATION, 1);
+
+	glState.bindVertexArray(0);
+	glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// the data lives on the GPU now
+	std::vector<unsigned char>().swap(_vertexData);
+	std::vector<uint32_t>().swap(_indexData);
+}
+
+VertexFormat ModelBatch::format() const
+{
+	return _format;
+}
+
+const AABB& ModelBatch::bounds(GLuint mesh) const
+{
+	return _meshes[mesh].bounds;
+}
+
+void ModelBatch::queue(GLuint mesh, const glm::mat4& modelMatrix)
+{
+	const ModelBatchMesh& range = _meshes[mesh];
+
+	ModelDrawData draw = {};
+	draw.modelMatrix = modelMatrix;
+	if (_format == VertexFormat::QUANTIZED) {
+		draw.positionOffset = glm::vec4(range.bounds.min, 0.0f);
+		draw.positionScale = glm::vec4(range.bounds.max - range.bounds.min, 0.0f);
+	}
+	else
+		draw.positionScale = glm::vec4(1.0f);
+	draw.materialIndex = range.materialIndex;
+
+	DrawElementsIndirectCommand command;
+	command.count = range.indexCount;
+	command.instanceCount = 1;
+	command.firstIndex = range.firstIndex;
+	command.baseVertex = range.baseVertex;
+	command.baseInstance = (GLuint)_commands.size();
+
+	_draws.push_back(draw);
+	_commands.push_back(command);
+}
+
+void ModelBatch::draw(const Shader& shader)
+{
+	if (_commands.empty()) return;
+
+	GLsizei count = (GLsizei)_commands.size();
+	if (count > _drawIdCapacity) {
+		_drawIdCapacity = std::max(count, _drawIdCapacity * 2);
+		std::vector<GLuint> drawIds(_drawIdCapacity);
+		for (GLsizei i = 0; i < _drawIdCapacity; i++)
+			drawIds[i] = (GLuint)i;
+		glState.bindBuffer(GL_ARRAY_BUFFER, _drawIdBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawIds.size() * sizeof(GLuint), drawIds.data(), GL_STATIC_DRAW);
+	}
+
+	// orphan the previous storage, both buffers are rewritten every frame
+	glState.bindBuffer(GL_SHADER_STORAGE_BUFFER, _drawBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, _draws.size() * sizeof(ModelDrawData), _draws.data(), GL_DYNAMIC_DRAW);
+	glState.bindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, _drawBuffer);
+	glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, _commands.size() * sizeof(DrawElementsIndirectCommand), _commands.data(), GL_DYNAMIC_DRAW);
+
+	shader.setBool("quantizedVertex", _format == VertexFormat::QUANTIZED);
+	glState.bindVertexArray(_vao);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, _indexType, (void*)0, count, 0);
+	renderStats.drawCalls++;
+
+	_draws.clear();
+	_commands.clear();
+}
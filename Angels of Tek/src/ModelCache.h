@@ -0,0 +1,465 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AABB.h"
+#include "MappedFile.h"
+#include "Mesh.h"
+
+/*!
+ * Binary model cache format, all values little-endian and 4-byte aligned:
+ *
+ *   ModelCacheHeader
+ *   ModelCacheMesh[meshCount]
+ *   ModelCacheTexture[textureCount]
+ *   per mesh: Vertex[vertexCount]
+ *   per mesh: uint16_t or uint32_t[indexCount], padded to 4 bytes
+ *   string table of the texture types and paths
+ *
+ * It holds the meshes as the import optimized them (see MeshOptimizer), with the vertices in the final
+ * format of the GPU (Vertex or QuantizedVertex) and 16-bit indices where the vertex count allows, so the
+ * vertex and index tables are handed to OpenGL straight from the mapped file. The source file is only
+ * parsed again if its size or modification time, the import flags or the vertex format change.
+ */
+static const char MODEL_CACHE_MAGIC[4] = { 'A', 'O', 'T', 'M' };
+static const uint32_t MODEL_CACHE_VERSION = 3;
+
+struct ModelCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t importFlags;
+
+	/*!
+	 * VertexFormat of the vertices and the size of one vertex when the cache was written
+	 */
+	uint32_t vertexFormat;
+	uint32_t vertexSize;
+	uint32_t reserved;
+
+	/*!
+	 * Size and modification time of the source file when the cache was written
+	 */
+	uint64_t sourceSize;
+	int64_t sourceTime;
+
+	uint32_t meshCount;
+	uint32_t textureCount;
+
+	/*!
+	 * Byte offset and size of the string table
+	 */
+	uint32_t stringOffset;
+	uint32_t stringSize;
+};
+
+struct ModelCacheMesh {
+	/*!
+	 * Byte offsets of the vertex and index tables of the mesh from the start of the file
+	 */
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+
+	/*!
+	 * Range of the textures of the mesh in the texture table
+	 */
+	uint32_t firstTexture;
+	uint32_t textureCount;
+
+	/*!
+	 * Bounds of the vertex positions, quantized positions are relative to them
+	 */
+	float boundsMin[3];
+	float boundsMax[3];
+
+	/*!
+	 * Size of one index in bytes, 2 for meshes with up to 65536 vertices, otherwise 4
+	 */
+	uint32_t indexSize;
+	uint32_t reserved;
+};
+
+struct ModelCacheTexture {
+	/*!
+	 * Offsets and lengths in the string table, e.g. "texture_diffuse" and a path relative to the model
+	 */
+	uint32_t typeOffset;
+	uint32_t typeLength;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+};
+
+static_assert(sizeof(ModelCacheHeader) == 56, "model cache header has to be 56 bytes");
+static_assert(sizeof(ModelCacheMesh) == 56, "model cache mesh has to be 56 bytes");
+static_assert(sizeof(ModelCacheTexture) == 16, "model cache texture has to be 16 bytes");
+
+/*!
+ * A mesh as imported, the input of ModelCache::encode()
+ */
+struct ModelCacheSource {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+
+	/*!
+	 * Type and path of every texture of the mesh
+	 */
+	std::vector<std::pair<std::string, std::string>> textures;
+};
+
+/*!
+ * Read-only view of a model cache, either a mapped file or an image held in memory
+ */
+class ModelCache
+{
+protected:
+	MappedFile _file;
+	std::vector<char> _image;
+
+	const char* _data;
+	size_t _size;
+	const ModelCacheHeader* _header;
+	const ModelCacheMesh* _meshes;
+	const ModelCacheTexture* _textures;
+
+	/*!
+	 * Checks that every table of the image lies within it, so the records can be read without further checks
+	 */
+	bool validate();
+
+	std::string stringAt(uint32_t offset, uint32_t length) const;
+
+public:
+	ModelCache();
+
+	ModelCache(const ModelCache&) = delete;
+	ModelCache& operator=(const ModelCache&) = delete;
+
+	/*!
+	 * Maps a cache file if it is still up to date
+	 * @param path: path of the cache file
+	 * @param sourcePath: path of the model file the cache was created from
+	 * @param importFlags: Assimp post processing flags of the import
+	 * @param format: format of the vertices
+	 * @return whether the file is a valid cache of the current source file, flags and format
+	 */
+	bool open(const std::string& path, const std::string& sourcePath, uint32_t importFlags, VertexFormat format);
+
+	/*!
+	 * Uses a cache image created by encode()
+	 * @param image: the encoded cache
+	 * @return whether the image is a valid cache
+	 */
+	bool load(std::vector<char> image);
+
+	bool isOpen() const;
+	VertexFormat vertexFormat() const;
+	unsigned int meshCount() const;
+	const ModelCacheMesh& mesh(unsigned int i) const;
+
+	/*!
+	 * @return the vertices of a mesh, Vertex or QuantizedVertex depending on vertexFormat()
+	 */
+	const void* vertices(unsigned int mesh) const;
+
+	/*!
+	 * @return the indices of a mesh, 16 or 32 bit depending on its indexSize
+	 */
+	const void* indices(unsigned int mesh) const;
+
+	/*!
+	 * @return GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, the OpenGL type of the indices of a mesh
+	 */
+	GLenum indexType(unsigned int mesh) const;
+	AABB bounds(unsigned int mesh) const;
+	std::string textureType(unsigned int mesh, unsigned int i) const;
+	std::string texturePath(unsigned int mesh, unsigned int i) const;
+
+	/*!
+	 * @return the path of the cache file of a model file
+	 */
+	static std::string cachePath(const std::string& sourcePath);
+
+	/*!
+	 * Reads the size and modification time of a file
+	 * @return whether the file exists
+	 */
+	static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time);
+
+	/*!
+	 * Encodes imported meshes into the binary format
+	 * @param sourcePath: path of the model file, its size and modification time are stored
+	 * @param importFlags: Assimp post processing flags of the import
+	 * @param format: format the vertices are stored in, quantized ones relative to the bounds of their mesh
+	 * @param meshes: the meshes
+	 * @return the image of the cache file
+	 */
+	static std::vector<char> encode(const std::string& sourcePath, uint32_t importFlags, VertexFormat format, const std::vector<ModelCacheSource>& meshes);
+
+	/*!
+	 * @return the size of one vertex of a format
+	 */
+	static size_t vertexSize(VertexFormat format);
+
+	/*!
+	 * Writes an image created by encode()
+	 * @return whether the file was written
+	 */
+	static bool write(const std::string& path, const std::vector<char>& image);
+};
+
+ModelCache::ModelCache()
+	: _data(nullptr), _size(0), _header(nullptr), _meshes(nullptr), _textures(nullptr)
+{
+}
+
+bool ModelCache::open(const std::string& path, const std::string& sourcePath, uint32_t importFlags, VertexFormat format)
+{
+	_image.clear();
+	if (!_file.open(path.c_str())) {
+		_data = nullptr;
+		_header = nullptr;
+		return false;
+	}
+
+	_data = _file.data();
+	_size = _file.size();
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!validate() || !sourceStamp(sourcePath, sourceSize, sourceTime) || _header->sourceSize != sourceSize
+		|| _header->sourceTime != sourceTime || _header->importFlags != importFlags || _header->vertexFormat != (uint32_t)format) {
+		_header = nullptr;
+		_file.close();
+		return false;
+	}
+	return true;
+}
+
+bool ModelCache::load(std::vector<char> image)
+{
+	_file.close();
+	_image = std::move(image);
+	_data = _image.data();
+	_size = _image.size();
+	if (!validate()) {
+		_image.clear();
+		return false;
+	}
+	return true;
+}
+
+bool ModelCache::validate()
+{
+	_header = nullptr;
+	_meshes = nullptr;
+	_textures = nullptr;
+
+	if (_data == nullptr || _size < sizeof(ModelCacheHeader)) return false;
+
+	const ModelCacheHeader* header = (const ModelCacheHeader*)_data;
+	uint64_t tablesEnd = sizeof(ModelCacheHeader) + (uint64_t)header->meshCount * sizeof(ModelCacheMesh)
+		+ (uint64_t)header->textureCount * sizeof(ModelCacheTexture);
+	if (std::memcmp(header->magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC)) != 0 || header->version != MODEL_CACHE_VERSION
+		|| header->vertexFormat > (uint32_t)VertexFormat::QUANTIZED || header->vertexSize != vertexSize((VertexFormat)header->vertexFormat)
+		|| tablesEnd > _size || (uint64_t)header->stringOffset + header->stringSize > _size)
+		return false;
+
+	const ModelCacheMesh* meshes = (const ModelCacheMesh*)(_data + sizeof(ModelCacheHeader));
+	const ModelCacheTexture* textures = (const ModelCacheTexture*)(meshes + header->meshCount);
+	for (uint32_t i = 0; i < header->meshCount; i++) {
+		const ModelCacheMesh& mesh = meshes[i];
+		uint64_t verticesEnd = mesh.vertexOffset + (uint64_t)mesh.vertexCount * header->vertexSize;
+		uint64_t indicesEnd = mesh.indexOffset + (uint64_t)mesh.indexCount * mesh.indexSize;
+		if ((mesh.indexSize != sizeof(uint16_t) && mesh.indexSize != sizeof(uint32_t)) || verticesEnd > _size || indicesEnd > _size || mesh.vertexOffset % 4 != 0 || mesh.indexOffset % 4 != 0
+			|| (uint64_t)mesh.firstTexture + mesh.textureCount > header->textureCount)
+			return false;
+	}
+	for (uint32_t i = 0; i < header->textureCount; i++) {
+		const ModelCacheTexture& texture = textures[i];
+		if ((uint64_t)texture.typeOffset + texture.typeLength > header->stringSize || (uint64_t)texture.pathOffset + texture.pathLength > header->stringSize)
+			return false;
+	}
+
+	_header = header;
+	_meshes = meshes;
+	_textures = textures;
+	return true;
+}
+
+bool ModelCache::isOpen() const
+{
+	return _header != nullptr;
+}
+
+VertexFormat ModelCache::vertexFormat() const
+{
+	return (VertexFormat)_header->vertexFormat;
+}
+
+unsigned int ModelCache::meshCount() const
+{
+	return _header != nullptr ? _header->meshCount : 0;
+}
+
+const ModelCacheMesh& ModelCache::mesh(unsigned int i) const
+{
+	return _meshes[i];
+}
+
+const void* ModelCache::vertices(unsigned int mesh) const
+{
+	return _data + _meshes[mesh].vertexOffset;
+}
+
+const void* ModelCache::indices(unsigned int mesh) const
+{
+	return _data + _meshes[mesh].indexOffset;
+}
+
+GLenum ModelCache::indexType(unsigned int mesh) const
+{
+	return _meshes[mesh].indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+AABB ModelCache::bounds(unsigned int mesh) const
+{
+	const ModelCacheMesh& table = _meshes[mesh];
+	return AABB(glm::vec3(table.boundsMin[0], table.boundsMin[1], table.boundsMin[2]), glm::vec3(table.boundsMax[0], table.boundsMax[1], table.boundsMax[2]));
+}
+
+std::string ModelCache::stringAt(uint32_t offset, uint32_t length) const
+{
+	return std::string(_data + _header->stringOffset + offset, length);
+}
+
+std::string ModelCache::textureType(unsigned int mesh, unsigned int i) const
+{
+	const ModelCacheTexture& texture = _textures[_meshes[mesh].firstTexture + i];
+	return stringAt(texture.typeOffset, texture.typeLength);
+}
+
+std::string ModelCache::texturePath(unsigned int mesh, unsigned int i) const
+{
+	const ModelCacheTexture& texture = _textures[_meshes[mesh].firstTexture + i];
+	return stringAt(texture.pathOffset, texture.pathLength);
+}
+
+std::string ModelCache::cachePath(const std::string& sourcePath)
+{
+	return sourcePath + ".aotm";
+}
+
+size_t ModelCache::vertexSize(VertexFormat format)
+{
+	return format == VertexFormat::QUANTIZED ? sizeof(QuantizedVertex) : sizeof(Vertex);
+}
+
+bool ModelCache::sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+{
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) return false;
+	size = (uint64_t)status.st_size;
+	time = (int64_t)status.st_mtime;
+	return true;
+}
+
+std::vector<char> ModelCache::encode(const std::string& sourcePath, uint32_t importFlags, VertexFormat format, const std::vector<ModelCacheSource>& meshes)
+{
+	ModelCacheHeader header = {};
+	std::memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(MODEL_CACHE_MAGIC));
+	header.version = MODEL_CACHE_VERSION;
+	header.importFlags = importFlags;
+	header.vertexFormat = (uint32_t)format;
+	header.vertexSize = (uint32_t)vertexSize(format);
+	sourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+	header.meshCount = (uint32_t)meshes.size();
+
+	// lay out the tables first, then all vertices, all indices and the strings
+	std::vector<ModelCacheMesh> tables(meshes.size(), ModelCacheMesh());
+	std::vector<ModelCacheTexture> textures;
+	std::string strings;
+	for (size_t i = 0; i < meshes.size(); i++) {
+		tables[i].firstTexture = (uint32_t)textures.size();
+		tables[i].textureCount = (uint32_t)meshes[i].textures.size();
+		for (const auto& texture : meshes[i].textures) {
+			ModelCacheTexture entry;
+			entry.typeOffset = (uint32_t)strings.size();
+			entry.typeLength = (uint32_t)texture.first.size();
+			strings += texture.first;
+			entry.pathOffset = (uint32_t)strings.size();
+			entry.pathLength = (uint32_t)texture.second.size();
+			strings += texture.second;
+			textures.push_back(entry);
+		}
+
+		AABB bounds;
+		for (const Vertex& vertex : meshes[i].vertices)
+			bounds.grow(vertex.Position);
+		for (int axis = 0; axis < 3; axis++) {
+			tables[i].boundsMin[axis] = bounds.min[axis];
+			tables[i].boundsMax[axis] = bounds.max[axis];
+		}
+	}
+	header.textureCount = (uint32_t)textures.size();
+
+	size_t offset = sizeof(ModelCacheHeader) + tables.size() * sizeof(ModelCacheMesh) + textures.size() * sizeof(ModelCacheTexture);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		tables[i].vertexOffset = (uint32_t)offset;
+		tables[i].vertexCount = (uint32_t)meshes[i].vertices.size();
+		offset += meshes[i].vertices.size() * header.vertexSize;
+	}
+	for (size_t i = 0; i < meshes.size(); i++) {
+		tables[i].indexOffset = (uint32_t)offset;
+		tables[i].indexCount = (uint32_t)meshes[i].indices.size();
+		tables[i].indexSize = meshes[i].vertices.size() <= 65536 ? sizeof(uint16_t) : sizeof(uint32_t);
+		offset += (meshes[i].indices.size() * tables[i].indexSize + 3) & ~(size_t)3;
+	}
+	header.stringOffset = (uint32_t)offset;
+	header.stringSize = (uint32_t)strings.size();
+	offset += strings.size();
+
+	std::vector<char> image(offset);
+	char* out = image.data();
+	std::memcpy(out, &header, sizeof(header));
+	if (!tables.empty())
+		std::memcpy(out + sizeof(header), tables.data(), tables.size() * sizeof(ModelCacheMesh));
+	if (!textures.empty())
+		std::memcpy(out + sizeof(header) + tables.size() * sizeof(ModelCacheMesh), textures.data(), textures.size() * sizeof(ModelCacheTexture));
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (format == VertexFormat::QUANTIZED) {
+			AABB bounds(glm::vec3(tables[i].boundsMin[0], tables[i].boundsMin[1], tables[i].boundsMin[2]),
+				glm::vec3(tables[i].boundsMax[0], tables[i].boundsMax[1], tables[i].boundsMax[2]));
+			QuantizedVertex* quantized = (QuantizedVertex*)(out + tables[i].vertexOffset);
+			for (size_t v = 0; v < meshes[i].vertices.size(); v++)
+				quantized[v] = quantizeVertex(meshes[i].vertices[v], bounds);
+		}
+		else if (!meshes[i].vertices.empty())
+			std::memcpy(out + tables[i].vertexOffset, meshes[i].vertices.data(), meshes[i].vertices.size() * sizeof(Vertex));
+		if (tables[i].indexSize == sizeof(uint16_t)) {
+			uint16_t* indices = (uint16_t*)(out + tables[i].indexOffset);
+			for (size_t j = 0; j < meshes[i].indices.size(); j++)
+				indices[j] = (uint16_t)meshes[i].indices[j];
+		}
+		else if (!meshes[i].indices.empty())
+			std::memcpy(out + tables[i].indexOffset, meshes[i].indices.data(), meshes[i].indices.size() * sizeof(uint32_t));
+	}
+	if (!strings.empty())
+		std::memcpy(out + header.stringOffset, strings.data(), strings.size());
+
+	return image;
+}
+
+bool ModelCache::write(const std::string& path, const std::vector<char>& image)
+{
+	std::ofstream file(path, std::ios::binary);
+	file.write(image.data(), image.size());
+	return (bool)file;
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+/*!
+ * CPU version of the terrain height function of simon.fag
+ *
+ * snoise() and getZ() follow the shader line by line with glm, the 4-wide versions evaluate the same
+ * operations in SSE2 lanes. All of them work in single precision like the GPU, results agree with the
+ * shader up to float rounding (FMA contraction, sin/cos precision).
+ */
+class Noise
+{
+protected:
+	static __m128 floor4(__m128 x);
+	static __m128 mod289(__m128 x);
+	static __m128 permute(__m128 x);
+
+public:
+	/*!
+	 * World units per noise unit, pos = world.xz / RESOLUTION in simon.fag
+	 */
+	static constexpr float RESOLUTION = 10.0f;
+
+	/*!
+	 * 2D simplex noise, scalar
+	 * @param v: position
+	 * @return noise value in [-1, 1]
+	 */
+	static float snoise(glm::vec2 v);
+
+	/*!
+	 * 2D simplex noise for four positions at once
+	 * @param x: x coordinates
+	 * @param y: y coordinates
+	 * @return noise values
+	 */
+	static __m128 snoise4(__m128 x, __m128 y);
+
+	/*!
+	 * Terrain height function of simon.fag, scalar
+	 * @param pos: position in noise units
+	 * @param time: u_time of the frame
+	 * @return height in [0, 1]
+	 */
+	static float getZ(glm::vec2 pos, float time);
+
+	/*!
+	 * Terrain height function of simon.fag for four positions at once
+	 * @param x: x coordinates in noise units
+	 * @param y: y coordinates in noise units
+	 * @param time: u_time of the frame
+	 * @return heights
+	 */
+	static __m128 getZ4(__m128 x, __m128 y, float time);
+
+	/*!
+	 * Height of the terrain at a world position
+	 * @param x: world x coordinate
+	 * @param z: world z coordinate
+	 * @param time: u_time of the frame
+	 * @return height in [0, 1]
+	 */
+	static float height(float x, float z, float time);
+
+	/*!
+	 * Heights of many world positions, evaluated four at a time on the calling thread
+	 * @param x: world x coordinates
+	 * @param z: world z coordinates
+	 * @param count: number of positions
+	 * @param time: u_time of the frame
+	 * @param out: receives count heights
+	 */
+	static void heights(const float* x, const float* z, size_t count, float time, float* out);
+
+	/*!
+	 * Heights of a regular grid of world positions, rows are spread across the thread pool
+	 * @param pool: the thread pool
+	 * @param x0: world x coordinate of the first column
+	 * @param z0: world z coordinate of the first row
+	 * @param spacing: distance between neighbouring grid points
+	 * @param columns: number of grid points per row
+	 * @param rows: number of rows
+	 * @param time: u_time of the frame
+	 * @param out: receives columns * rows heights, row by row
+	 */
+	static void heightGrid(ThreadPool& pool, float x0, float z0, float spacing, int columns, int rows, float time, float* out);
+};
+
+constexpr float Noise::RESOLUTION;
+
+/* --------------------------------------------- */
+// Scalar
+/* --------------------------------------------- */
+
+float Noise::snoise(glm::vec2 v)
+{
+	const glm::vec4 C = glm::vec4(0.211324865405187,  // (3.0-sqrt(3.0))/6.0
+		0.366025403784439,  // 0.5*(sqrt(3.0)-1.0)
+		-0.577350269189626,  // -1.0 + 2.0 * C.x
+		0.024390243902439); // 1.0 / 41.0
+	glm::vec2 i = glm::floor(v + glm::dot(v, glm::vec2(C.y)));
+	glm::vec2 x0 = v - i + glm::dot(i, glm::vec2(C.x));
+	glm::vec2 i1 = (x0.x > x0.y) ? glm::vec2(1.0f, 0.0f) : glm::vec2(0.0f, 1.0f);
+	glm::vec4 x12 = glm::vec4(x0.x, x0.y, x0.x, x0.y) + glm::vec4(C.x, C.x, C.z, C.z);
+	x12.x -= i1.x;
+	x12.y -= i1.y;
+
+	auto mod289 = [](glm::vec3 x) { return x - glm::floor(x * (1.0f / 289.0f)) * 289.0f; };
+	auto permute = [&](glm::vec3 x) { return mod289(((x * 34.0f) + 1.0f) * x); };
+
+	i = i - glm::floor(i * (1.0f / 289.0f)) * 289.0f; // Avoid truncation effects in permutation
+	glm::vec3 p = permute(permute(i.y + glm::vec3(0.0f, i1.y, 1.0f)) + i.x + glm::vec3(0.0f, i1.x, 1.0f));
+
+	glm::vec3 m = glm::max(0.5f - glm::vec3(glm::dot(x0, x0), glm::dot(glm::vec2(x12.x, x12.y), glm::vec2(x12.x, x12.y)), glm::dot(glm::vec2(x12.z, x12.w), glm::vec2(x12.z, x12.w))), 0.0f);
+	m = m * m;
+	m = m * m;
+	glm::vec3 x = 2.0f * glm::fract(p * C.w) - 1.0f;
+	glm::vec3 h = glm::abs(x) - 0.5f;
+	glm::vec3 ox = glm::floor(x + 0.5f);
+	glm::vec3 a0 = x - ox;
+	m *= 1.79284291400159f - 0.85373472095314f * (a0 * a0 + h * h);
+	glm::vec3 g;
+	g.x = a0.x * x0.x + h.x * x0.y;
+	g.y = a0.y * x12.x + h.y * x12.y;
+	g.z = a0.z * x12.z + h.z * x12.w;
+	return 130.0f * glm::dot(m, g);
+}
+
+float Noise::getZ(glm::vec2 pos, float time)
+{
+	glm::vec2 vel = glm::vec2(time * 0.1f);
+	float DF = 0.0f;
+	float a = 0.0f;
+
+	DF += snoise(pos + vel) * 0.25f + 0.25f;
+	a = snoise(pos * glm::vec2(std::cos(time * 0.15f), std::sin(time * 0.1f)) * 0.1f) * 3.1415f;
+	vel = glm::vec2(std::cos(a), std::sin(a));
+	DF += snoise(pos + vel) * 0.25f + 0.25f;
+
+	return glm::smoothstep(0.7f, 0.75f, glm::fract(DF));
+}
+
+float Noise::height(float x, float z, float time)
+{
+	return getZ(glm::vec2(x, z) / RESOLUTION, time);
+}
+
+/* --------------------------------------------- */
+// SSE2
+/* --------------------------------------------- */
+
+__m128 Noise::floor4(__m128 x)
+{
+	// SSE2 has no floor, truncate and step down where truncation rounded up (negative values)
+	__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+__m128 Noise::mod289(__m128 x)
+{
+	return _mm_sub_ps(x, _mm_mul_ps(floor4(_mm_mul_ps(x, _mm_set1_ps(1.0f / 289.0f))), _mm_set1_ps(289.0f)));
+}
+
+__m128 Noise::permute(__m128 x)
+{
+	return mod289(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(34.0f)), _mm_set1_ps(1.0f)), x));
+}
+
+__m128 Noise::snoise4(__m128 vx, __m128 vy)
+{
+	const __m128 Cx = _mm_set1_ps(0.211324865405187f);
+	const __m128 Cy = _mm_set1_ps(0.366025403784439f);
+	const __m128 Cz = _mm_set1_ps(-0.577350269189626f);
+	const __m128 Cw = _mm_set1_ps(0.024390243902439f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+
+	// i = floor(v + dot(v, C.yy)), x0 = v - i + dot(i, C.xx)
+	__m128 s = _mm_mul_ps(_mm_add_ps(vx, vy), Cy);
+	__m128 ix = floor4(_mm_add_ps(vx, s));
+	__m128 iy = floor4(_mm_add_ps(vy, s));
+	__m128 t = _mm_mul_ps(_mm_add_ps(ix, iy), Cx);
+	__m128 x0x = _mm_add_ps(_mm_sub_ps(vx, ix), t);
+	__m128 x0y = _mm_add_ps(_mm_sub_ps(vy, iy), t);
+
+	// i1 = (x0.x > x0.y) ? (1, 0) : (0, 1)
+	__m128 i1x = _mm_and_ps(_mm_cmpgt_ps(x0x, x0y), one);
+	__m128 i1y = _mm_sub_ps(one, i1x);
+
+	// x12 = x0.xyxy + C.xxzz, x12.xy -= i1
+	__m128 x1x = _mm_sub_ps(_mm_add_ps(x0x, Cx), i1x);
+	__m128 x1y = _mm_sub_ps(_mm_add_ps(x0y, Cx), i1y);
+	__m128 x2x = _mm_add_ps(x0x, Cz);
+	__m128 x2y = _mm_add_ps(x0y, Cz);
+
+	ix = mod289(ix);
+	iy = mod289(iy);
+	__m128 p0 = permute(_mm_add_ps(permute(iy), ix));
+	__m128 p1 = permute(_mm_add_ps(_mm_add_ps(permute(_mm_add_ps(iy, i1y)), ix), i1x));
+	__m128 p2 = permute(_mm_add_ps(_mm_add_ps(permute(_mm_add_ps(iy, one)), ix), one));
+
+	// m = max(0.5 - (dot(x0, x0), dot(x1, x1), dot(x2, x2)), 0) ^ 4
+	__m128 m0 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x0x, x0x), _mm_mul_ps(x0y, x0y))), zero);
+	__m128 m1 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x1x, x1x), _mm_mul_ps(x1y, x1y))), zero);
+	__m128 m2 = _mm_max_ps(_mm_sub_ps(half, _mm_add_ps(_mm_mul_ps(x2x, x2x), _mm_mul_ps(x2y, x2y))), zero);
+	m0 = _mm_mul_ps(m0, m0); m0 = _mm_mul_ps(m0, m0);
+	m1 = _mm_mul_ps(m1, m1); m1 = _mm_mul_ps(m1, m1);
+	m2 = _mm_mul_ps(m2, m2); m2 = _mm_mul_ps(m2, m2);
+
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 k0 = _mm_set1_ps(1.79284291400159f);
+	const __m128 k1 = _mm_set1_ps(0.85373472095314f);
+	__m128 p[3] = { p0, p1, p2 };
+	__m128 m[3] = { m0, m1, m2 };
+	__m128 gx[3] = { x0x, x1x, x2x };
+	__m128 gy[3] = { x0y, x1y, x2y };
+	__m128 sum = zero;
+	for (int c = 0; c < 3; c++) {
+		// x = 2 * fract(p * C.w) - 1, h = abs(x) - 0.5, a0 = x - floor(x + 0.5)
+		__m128 q = _mm_mul_ps(p[c], Cw);
+		__m128 x = _mm_sub_ps(_mm_mul_ps(two, _mm_sub_ps(q, floor4(q))), one);
+		__m128 h = _mm_sub_ps(_mm_and_ps(x, absMask), half);
+		__m128 a0 = _mm_sub_ps(x, floor4(_mm_add_ps(x, half)));
+		__m128 mc = _mm_mul_ps(m[c], _mm_sub_ps(k0, _mm_mul_ps(k1, _mm_add_ps(_mm_mul_ps(a0, a0), _mm_mul_ps(h, h)))));
+		__m128 g = _mm_add_ps(_mm_mul_ps(a0, gx[c]), _mm_mul_ps(h, gy[c]));
+		sum = _mm_add_ps(sum, _mm_mul_ps(mc, g));
+	}
+	return _mm_mul_ps(_mm_set1_ps(130.0f), sum);
+}
+
+__m128 Noise::getZ4(__m128 x, __m128 y, float time)
+{
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	__m128 vel = _mm_set1_ps(time * 0.1f);
+
+	__m128 DF = _mm_add_ps(_mm_mul_ps(snoise4(_mm_add_ps(x, vel), _mm_add_ps(y, vel)), quarter), quarter);
+
+	__m128 rx = _mm_set1_ps(std::cos(time * 0.15f) * 0.1f);
+	__m128 ry = _mm_set1_ps(std::sin(time * 0.1f) * 0.1f);
+	__m128 a = _mm_mul_ps(snoise4(_mm_mul_ps(x, rx), _mm_mul_ps(y, ry)), _mm_set1_ps(3.1415f));
+
+	// no SSE sin/cos, the angle is the only per-lane transcendental
+	alignas(16) float angles[4], velX[4], velY[4];
+	_mm_store_ps(angles, a);
+	for (int lane = 0; lane < 4; lane++) {
+		velX[lane] = std::cos(angles[lane]);
+		velY[lane] = std::sin(angles[lane]);
+	}
+	__m128 n = snoise4(_mm_add_ps(x, _mm_load_ps(velX)), _mm_add_ps(y, _mm_load_ps(velY)));
+	DF = _mm_add_ps(DF, _mm_add_ps(_mm_mul_ps(n, quarter), quarter));
+
+	// smoothstep(0.7, 0.75, fract(DF))
+	__m128 f = _mm_sub_ps(DF, floor4(DF));
+	__m128 s = _mm_mul_ps(_mm_sub_ps(f, _mm_set1_ps(0.7f)), _mm_set1_ps(1.0f / 0.05f));
+	s = _mm_min_ps(_mm_max_ps(s, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	return _mm_mul_ps(_mm_mul_ps(s, s), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_set1_ps(2.0f), s)));
+}
+
+void Noise::heights(const float* x, const float* z, size_t count, float time, float* out)
+{
+	const __m128 scale = _mm_set1_ps(1.0f / RESOLUTION);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, getZ4(_mm_mul_ps(_mm_loadu_ps(x + i), scale), _mm_mul_ps(_mm_loadu_ps(z + i), scale), time));
+
+	// pad the tail to a full vector
+	if (i < count) {
+		float tailX[4] = {}, tailZ[4] = {}, tailOut[4];
+		for (size_t j = i; j < count; j++) {
+			tailX[j - i] = x[j];
+			tailZ[j - i] = z[j];
+		}
+		_mm_storeu_ps(tailOut, getZ4(_mm_mul_ps(_mm_loadu_ps(tailX), scale), _mm_mul_ps(_mm_loadu_ps(tailZ), scale), time));
+		for (size_t j = i; j < count; j++)
+			out[j] = tailOut[j - i];
+	}
+}
+
+void Noise::heightGrid(ThreadPool& pool, float x0, float z0, float spacing, int columns, int rows, float time, float* out)
+{
+	pool.parallelFor(rows, 4, [=](size_t firstRow, size_t lastRow) {
+		std::vector<float> x(columns), z(columns);
+		for (int col = 0; col < columns; col++)
+			x[col] = x0 + col * spacing;
+
+		for (size_t row = firstRow; row < lastRow; row++) {
+			std::fill(z.begin(), z.end(), z0 + row * spacing);
+			heights(x.data(), z.data(), columns, time, out + row * columns);
+		}
+	});
+}
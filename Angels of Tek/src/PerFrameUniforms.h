@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "GLState.h"
+#include "Light.h"
+
+/*!
+ * CPU copy of the PerFrame uniform block in assets/shaders/perFrame.glsl
+ * Laid out by the std140 rules: every vec3 starts on a 16 byte boundary, so
+ * arrays of vec3 and the light struct members are stored as padded vec4s
+ */
+struct PerFrameData {
+	glm::mat4 viewProjMatrix;
+	glm::vec3 cameraWorldPosition;
+	float brightness;
+	glm::vec3 skyColor;
+	float time;
+	glm::vec4 lightPositions[4];
+	glm::vec4 lightColors[4];
+	glm::vec4 dirLColor;
+	glm::vec4 dirLDirection;
+	glm::vec4 pointLColor;
+	glm::vec4 pointLPosition;
+	glm::vec4 pointLAttenuation;
+};
+
+static_assert(sizeof(PerFrameData) == 304, "PerFrameData must match the std140 layout of the PerFrame block");
+
+/*!
+ * Uniform buffer holding the state that is shared by all programs for one frame
+ * (camera, brightness, time, sky color and lights). It is bound to a fixed binding
+ * point that every shader including perFrame.glsl reads from, so a frame updates
+ * one buffer instead of setting the same uniforms on every program.
+ */
+class PerFrameUniforms
+{
+protected:
+	/*!
+	 * Uniform buffer object
+	 */
+	GLuint _ubo;
+
+public:
+	/*!
+	 * Binding point of the PerFrame block, see perFrame.glsl
+	 */
+	static const GLuint BINDING = 0;
+
+	/*!
+	 * Values uploaded by the next call to upload()
+	 */
+	PerFrameData data;
+
+	PerFrameUniforms();
+	~PerFrameUniforms();
+
+	/*!
+	 * Stores a directional light in the block
+	 * @param light: the light to store
+	 */
+	void setDirectionalLight(const DirectionalLight& light);
+
+	/*!
+	 * Stores a point light in the block
+	 * @param light: the light to store
+	 */
+	void setPointLight(const PointLight& light);
+
+	/*!
+	 * Stores one of the PBR lights in the block
+	 * @param index: index of the light, 0 to 3
+	 * @param position: world position of the light
+	 * @param color: radiant color of the light
+	 */
+	void setLight(unsigned int index, glm::vec3 position, glm::vec3 color);
+
+	/*!
+	 * Uploads the whole block, call once per frame before the first draw
+	 */
+	void upload();
+};
+
+PerFrameUniforms::PerFrameUniforms()
+	: data()
+{
+	glGenBuffers(1, &_ubo);
+	glState.bindBuffer(GL_UNIFORM_BUFFER, _ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(PerFrameData), NULL, GL_DYNAMIC_DRAW);
+	glState.bindBufferBase(GL_UNIFORM_BUFFER, BINDING, _ubo);
+	glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+PerFrameUniforms::~PerFrameUniforms()
+{
+	glState.deleteBuffer(_ubo);
+}
+
+void PerFrameUniforms::setDirectionalLight(const DirectionalLight& light)
+{
+	data.dirLColor = glm::vec4(light.color, 0.0f);
+	data.dirLDirection = glm::vec4(light.direction, 0.0f);
+}
+
+void PerFrameUniforms::setPointLight(const PointLight& light)
+{
+	data.pointLColor = glm::vec4(light.color, 0.0f);
+	data.pointLPosition = glm::vec4(light.position, 1.0f);
+	data.pointLAttenuation = glm::vec4(light.attenuation, 0.0f);
+}
+
+void PerFrameUniforms::setLight(unsigned int index, glm::vec3 position, glm::vec3 color)
+{
+	data.lightPositions[index] = glm::vec4(position, 1.0f);
+	data.lightColors[index] = glm::vec4(color, 0.0f);
+}
+
+void PerFrameUniforms::upload()
+{
+	// orphan the previous storage so the driver does not wait for last frame's draws
+	glState.bindBuffer(GL_UNIFORM_BUFFER, _ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(PerFrameData), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PerFrameData), &data);
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "Frustum.h"
+#include "Geometry.h"
+#include "GLState.h"
+#include "InstancedGeometry.h"
+#include "Material.h"
+#include "Model.h"
+#include "RenderStats.h"
+#include "Shader.h"
+
+/*!
+ * Passes of a frame, drawn in this order
+ */
+enum class RenderPass : uint64_t {
+	OPAQUE_GEOMETRY = 0
+};
+
+/*!
+ * Kind of object a draw packet draws
+ */
+enum class DrawPacketType : uint8_t {
+	/*!
+	 * A geometry object, instanced together with packets of the same mesh and material
+	 */
+	GEOMETRY,
+	/*!
+	 * A geometry object that is drawn as it is, e.g. an InstancedGeometry with its own instances
+	 */
+	GEOMETRY_SINGLE,
+	/*!
+	 * One mesh of a model with its own buffers
+	 */
+	MODEL_MESH,
+	/*!
+	 * The meshes of a model that were queued on its batch
+	 */
+	MODEL_BATCH
+};
+
+/*!
+ * One draw of a frame, ordered by its sort key
+ */
+struct DrawPacket {
+	/*!
+	 * From the most to the least significant bits: pass (4), program (8), material (10), texture set (10),
+	 * mesh (8) and view distance (24), so packets are grouped by state and drawn front to back within a group
+	 */
+	uint64_t key;
+	DrawPacketType type;
+	Shader* shader;
+	Material* material;
+	Geometry* geometry;
+	Model* model;
+	unsigned int mesh;
+
+	/*!
+	 * Identity of the vertex data, packets with the same VAO and material are instanced together
+	 */
+	GLuint vao;
+};
+
+/*!
+ * Collects the draws of a frame from Geometry and Model objects, sorts them by a 64-bit key and draws them
+ * with as few program, material and texture changes as possible. Packets of the same mesh and palette
+ * material are merged into one instanced draw with the instanced variant of their program.
+ */
+class RenderQueue
+{
+protected:
+	/*!
+	 * A range of sorted packets that is drawn with one draw call, baseInstance is -1 for single draws
+	 */
+	struct Run {
+		size_t first;
+		GLsizei count;
+		GLint baseInstance;
+	};
+
+	std::vector<DrawPacket> _packets;
+	std::vector<Run> _runs;
+	std::vector<InstanceData> _instances;
+
+	/*!
+	 * Instance buffer of the merged draws, attached to the VAOs in _instancedVaos
+	 */
+	GLuint _vboInstances;
+	std::vector<GLuint> _instancedVaos;
+
+	/*!
+	 * Instanced variant of every program that has one
+	 */
+	std::map<const Shader*, Shader*> _instancedShaders;
+
+	/*!
+	 * Small ids of the materials for the sort key, in the order they were first submitted
+	 */
+	std::map<const Material*, uint64_t> _materialIds;
+
+	/*!
+	 * Batches that already have a packet this frame, one ModelBatch::draw draws the queued meshes of all their models
+	 */
+	std::vector<ModelBatch*> _batches;
+
+	glm::vec3 _eye;
+	float _maxDistance;
+
+	uint64_t materialId(const Material* material);
+	uint64_t distanceKey(const AABB& bounds) const;
+	void push(DrawPacketType type, uint64_t textureSet, const AABB& bounds, Shader* shader, Material* material,
+		Geometry* geometry, Model* model, unsigned int mesh, GLuint vao);
+
+	/*!
+	 * Whether two sorted packets can be drawn as instances of one draw
+	 */
+	bool instanceable(const DrawPacket& first, const DrawPacket& next) const;
+
+	/*!
+	 * Attaches the instance buffer to the VAO of a mesh once
+	 */
+	void prepareInstancing(GLuint vao);
+
+public:
+	RenderQueue();
+	~RenderQueue();
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	/*!
+	 * Registers the program that draws instances of the materials of another one
+	 * @param shader: the program of the materials
+	 * @param instanced: the same shading reading the instance attributes of InstancedGeometry
+	 */
+	void setInstancedShader(const Shader* shader, Shader* instanced);
+
+	/*!
+	 * Starts a frame, the view distances of the packets are measured from the eye
+	 * @param eye: camera position in world space
+	 * @param maxDistance: distance of the far plane
+	 */
+	void begin(glm::vec3 eye, float maxDistance);
+
+	/*!
+	 * Submits a geometry object if its bounding box intersects the frustum
+	 */
+	void submit(Geometry& geometry, const Frustum& frustum);
+
+	/*!
+	 * Culls the instances of an instanced geometry object and submits it as one packet
+	 */
+	void submit(InstancedGeometry& geometry, const Frustum& frustum);
+
+	/*!
+	 * Submits the meshes of a model that intersect the frustum, a batched model as one packet for its batch
+	 * @param shader: the shader the model is drawn with
+	 */
+	void submit(Model& model, Shader& shader, const Frustum& frustum);
+
+	/*!
+	 * Sorts and draws all submitted packets and empties the queue
+	 */
+	void flush();
+};
+
+RenderQueue::RenderQueue()
+	: _eye(0.0f), _maxDistance(1.0f)
+{
+	glGenBuffers(1, &_vboInstances);
+}
+
+RenderQueue::~RenderQueue()
+{
+	glState.deleteBuffer(_vboInstances);
+}
+
+void RenderQueue::setInstancedShader(const Shader* shader, Shader* instanced)
+{
+	_instancedShaders[shader] = instanced;
+}
+
+void RenderQueue::begin(glm::vec3 eye, float maxDistance)
+{
+	_packets.clear();
+	_batches.clear();
+	_eye = eye;
+	_maxDistance = maxDistance;
+}
+
+uint64_t RenderQueue::materialId(const Material* material)
+{
+	if (material == nullptr) return 0;
+
+	auto found = _materialIds.find(material);
+	if (found != _materialIds.end())
+		return found->second;
+
+	uint64_t id = (_materialIds.size() + 1) & 0x3FF;
+	_materialIds[material] = id;
+	return id;
+}
+
+uint64_t RenderQueue::distanceKey(const AABB& bounds) const
+{
+	float distance = glm::length(bounds.center() - _eye) / _maxDistance;
+	return (uint64_t)(glm::clamp(distance, 0.0f, 1.0f) * 0xFFFFFF);
+}
+
+void RenderQueue::push(DrawPacketType type, uint64_t textureSet, const AABB& bounds, Shader* shader, Material* material,
+	Geometry* geometry, Model* model, unsigned int mesh, GLuint vao)
+{
+	DrawPacket packet;
+	packet.key = ((uint64_t)RenderPass::OPAQUE_GEOMETRY << 60) | ((uint64_t)(shader->ID & 0xFF) << 52) | (materialId(material) << 42)
+		| ((textureSet & 0x3FF) << 32) | ((uint64_t)(vao & 0xFF) << 24) | distanceKey(bounds);
+	packet.type = type;
+	packet.shader = shader;
+	packet.material = material;
+	packet.geometry = geometry;
+	packet.model = model;
+	packet.mesh = mesh;
+	packet.vao = vao;
+	_packets.push_back(packet);
+}
+
+void RenderQueue::submit(Geometry& geometry, const Frustum& frustum)
+{
+	AABB bounds = geometry.getBounds();
+	if (!frustum.test(bounds)) return;
+
+	// palette materials share their textures, their layer is the texture set
+	Material* material = geometry.getMaterial();
+	PbrMaterial* pbr = dynamic_cast<PbrMaterial*>(material);
+	uint64_t textureSet = pbr != nullptr ? (uint64_t)(pbr->getMaterialIndex() + 1) : 0;
+	push(DrawPacketType::GEOMETRY, textureSet, bounds, material->getShader(), material, &geometry, nullptr, 0, geometry.getVao());
+}
+
+void RenderQueue::submit(InstancedGeometry& geometry, const Frustum& frustum)
+{
+	geometry.cull(frustum);
+
+	// the instances are spread out, so the packet sorts by the distance of the eye to itself
+	Material* material = geometry.getMaterial();
+	push(DrawPacketType::GEOMETRY_SINGLE, 0, AABB(_eye, _eye), material->getShader(), material, &geometry, nullptr, 0, geometry.getVao());
+}
+
+void RenderQueue::submit(Model& model, Shader& shader, const Frustum& frustum)
+{
+	ModelBatch* batch = model.getBatch();
+	if (batch != nullptr) {
+		model.Queue(frustum);
+		if (std::find(_batches.begin(), _batches.end(), batch) != _batches.end()) return;
+
+		_batches.push_back(batch);
+		push(DrawPacketType::MODEL_BATCH, 0, AABB(glm::vec3(model._modelMatrix[3]), glm::vec3(model._modelMatrix[3])), &shader, nullptr,
+			nullptr, &model, 0, 0);
+		return;
+	}
+
+	for (unsigned int i = 0; i < model.meshes.size(); i++) {
+		const Mesh& mesh = model.meshes[i];
+		AABB bounds = mesh.bounds.transform(model._modelMatrix);
+		if (!frustum.test(bounds)) continue;
+
+		uint64_t textureSet = mesh.textures.empty() ? 0 : mesh.textures[0].id;
+		push(DrawPacketType::MODEL_MESH, textureSet, bounds, &shader, nullptr, nullptr, &model, i, mesh.VAO);
+	}
+}
+
+bool RenderQueue::instanceable(const DrawPacket& first, const DrawPacket& next) const
+{
+	return first.type == DrawPacketType::GEOMETRY && next.type == DrawPacketType::GEOMETRY
+		&& first.vao == next.vao && first.material == next.material && first.shader == next.shader;
+}
+
+void RenderQueue::prepareInstancing(GLuint vao)
+{
+	if (std::find(_instancedVaos.begin(), _instancedVaos.end(), vao) != _instancedVaos.end()) return;
+
+	glState.bindVertexArray(vao);
+	glState.bindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+	InstancedGeometry::setupInstanceAttributes();
+	glState.bindVertexArray(0);
+	glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+	_instancedVaos.push_back(vao);
+}
+
+void RenderQueue::flush()
+{
+	std::sort(_packets.begin(), _packets.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+
+	// merge neighbouring packets of the same mesh and palette material, front to back within the instance buffer
+	_runs.clear();
+	_instances.clear();
+	for (size_t i = 0; i < _packets.size();) {
+		size_t end = i + 1;
+		while (end < _packets.size() && instanceable(_packets[i], _packets[end]))
+			end++;
+
+		Run run = { i, (GLsizei)(end - i), -1 };
+		PbrMaterial* pbr = dynamic_cast<PbrMaterial*>(_packets[i].material);
+		if (run.count > 1 && pbr != nullptr && _instancedShaders.count(_packets[i].shader) != 0) {
+			run.baseInstance = (GLint)_instances.size();
+			for (size_t j = i; j < end; j++)
+				_instances.push_back({ _packets[j].geometry->getModelMatrix(), (GLuint)pbr->getMaterialIndex() });
+		}
+		else
+			run.count = 1, end = i + 1;
+
+		_runs.push_back(run);
+		i = end;
+	}
+
+	if (!_instances.empty()) {
+		// orphan the previous storage, the buffer is rewritten every frame
+		glState.bindBuffer(GL_ARRAY_BUFFER, _vboInstances);
+		glBufferData(GL_ARRAY_BUFFER, _instances.size() * sizeof(InstanceData), _instances.data(), GL_DYNAMIC_DRAW);
+	}
+
+	// programs and materials are only set when they change from one run to the next
+	const Shader* program = nullptr;
+	const Material* material = nullptr;
+	auto use = [&](Shader* shader) {
+		if (shader == program) return;
+		shader->use();
+		program = shader;
+		material = nullptr;
+	};
+
+	for (const Run& run : _runs) {
+		const DrawPacket& packet = _packets[run.first];
+		switch (packet.type) {
+		case DrawPacketType::GEOMETRY:
+		case DrawPacketType::GEOMETRY_SINGLE:
+			if (run.baseInstance >= 0) {
+				use(_instancedShaders[packet.shader]);
+				prepareInstancing(packet.vao);
+				packet.geometry->drawInstances(run.count, (GLuint)run.baseInstance);
+				break;
+			}
+			use(packet.shader);
+			if (packet.material != material) {
+				packet.material->setUniforms();
+				material = packet.material;
+			}
+			packet.geometry->drawObject();
+			break;
+
+		case DrawPacketType::MODEL_MESH:
+			use(packet.shader);
+			packet.shader->setMat4("modelMatrix", packet.model->_modelMatrix);
+			packet.model->meshes[packet.mesh].Draw(*packet.shader);
+			material = nullptr;
+			break;
+
+		case DrawPacketType::MODEL_BATCH:
+			use(packet.shader);
+			packet.model->getBatch()->draw(*packet.shader);
+			material = nullptr;
+			break;
+		}
+	}
+
+	_packets.clear();
+	_batches.clear();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+/*!
+ * Counters collected while rendering a single frame
+ * Reset at the start of every frame, read by the benchmark output
+ */
+struct RenderStats {
+	/*!
+	 * Number of glDraw* calls issued this frame
+	 */
+	unsigned int drawCalls = 0;
+
+	/*!
+	 * Number of objects that passed the frustum test and were drawn
+	 */
+	unsigned int submitted = 0;
+
+	/*!
+	 * Number of objects the frustum test rejected
+	 */
+	unsigned int culled = 0;
+
+	/*!
+	 * Number of GL state changes glState issued this frame
+	 */
+	unsigned int stateCalls = 0;
+
+	/*!
+	 * Number of GL state changes glState dropped because the state was already set
+	 */
+	unsigned int skippedStateCalls = 0;
+
+	/*!
+	 * Time in milliseconds from the oldest key press shown by the last finished frame until the GPU was done with it,
+	 * -1 if that frame showed no key press, set by the frame pacer
+	 */
+	float inputLatencyMs = -1.0f;
+
+	/*!
+	 * Resets all counters to zero
+	 */
+	void reset()
+	{
+		*this = RenderStats();
+	}
+};
+
+/*!
+ * Stats of the frame that is currently being rendered
+ */
+RenderStats renderStats;
@@ -4,10 +4,26 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <set>
+#include <vector>
+
+#include "GLState.h"
+
+// pre-resolved uniform location, the type selects the matching Shader::set overload
+template <typename T>
+struct Uniform
+{
+	GLint location;
+
+	explicit Uniform(GLint location = -1) : location(location) {}
+};
 
 class Shader
 {
@@ -41,9 +57,9 @@ public:
 			// close file handlers
 			vShaderFile.close();
 			fShaderFile.close();
-			// convert stream into string
-			vertexCode = vShaderStream.str();
-			fragmentCode = fShaderStream.str();
+			// convert stream into string and paste in shared snippets
+			vertexCode = resolveIncludes(vShaderStream.str());
+			fragmentCode = resolveIncludes(fShaderStream.str());
 		}
 		catch (std::ifstream::failure e)
 		{
@@ -73,73 +89,215 @@ public:
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
 
+		programName = std::string(vertexPath) + "/" + fragmentPath;
+		reflectUniforms();
 	}
 	// activate the shader
 	// ------------------------------------------------------------------------
 	void use() const
 	{
-		glUseProgram(ID);
+		glState.useProgram(ID);
+	}
+	// looks up the location of an active uniform in the table built after linking,
+	// unknown names are reported once and yield -1, which glUniform* ignores
+	// ------------------------------------------------------------------------
+	GLint getUniformLocation(const char* name) const
+	{
+		GLint location = findUniformLocation(name);
+		if (location != -1)
+			return location;
+
+		// the set compares with the C string, so only the first report of a name builds a std::string
+		if (reportedUniforms.find(name) != reportedUniforms.end())
+			return -1;
+		reportedUniforms.insert(name);
+		std::cout << "WARNING::SHADER::UNIFORM_NOT_ACTIVE '" << name << "' in " << programName << " (misspelled or optimized out)" << std::endl;
+		return -1;
+	}
+	// same lookup without the report, for uniforms a program may or may not use
+	// ------------------------------------------------------------------------
+	GLint findUniformLocation(const char* name) const
+	{
+		std::vector<UniformInfo>::const_iterator it = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+			[](const UniformInfo& info, const char* n) { return std::strcmp(info.name.c_str(), n) < 0; });
+		if (it != uniforms.end() && it->name == name)
+			return it->location;
+		return -1;
+	}
+	// resolves a typed uniform handle, meant to be called once at load time
+	// ------------------------------------------------------------------------
+	template <typename T>
+	Uniform<T> getUniform(const char* name) const
+	{
+		return Uniform<T>(getUniformLocation(name));
 	}
 	// utility uniform functions
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setBool(const char* name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(getUniformLocation(name), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(getUniformLocation(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setFloat(const char* name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(getUniformLocation(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec2(const char* name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(getUniformLocation(name), 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec2(const char* name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(getUniformLocation(name), x, y);
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec3(const char* name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(getUniformLocation(name), 1, &value[0]);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setVec3(const char* name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(getUniformLocation(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec4(const char* name, const glm::vec4 &value) const
+	{
+		glUniform4fv(getUniformLocation(name), 1, &value[0]);
+	}
+	void setVec4(const char* name, float x, float y, float z, float w) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4f(getUniformLocation(name), x, y, z, w);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w) const
+	// ------------------------------------------------------------------------
+	void setMat2(const char* name, const glm::mat2 &mat) const
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat3(const char* name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat4(const char* name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
 	}
+	// typed uniform functions, no lookup at all
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void set(Uniform<bool> uniform, bool value) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniform1i(uniform.location, (int)value);
+	}
+	void set(Uniform<int> uniform, int value) const
+	{
+		glUniform1i(uniform.location, value);
+	}
+	void set(Uniform<float> uniform, float value) const
+	{
+		glUniform1f(uniform.location, value);
+	}
+	void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const
+	{
+		glUniform2fv(uniform.location, 1, &value[0]);
+	}
+	void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const
+	{
+		glUniform3fv(uniform.location, 1, &value[0]);
+	}
+	void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const
+	{
+		glUniform4fv(uniform.location, 1, &value[0]);
+	}
+	void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) const
+	{
+		glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+	}
+	void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) const
+	{
+		glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
+	struct UniformInfo
+	{
+		std::string name;
+		GLint location;
+	};
+
+	// active uniforms sorted by name, built once after linking
+	std::vector<UniformInfo> uniforms;
+	// names that were already reported as missing
+	mutable std::set<std::string, std::less<>> reportedUniforms;
+	std::string programName;
+
+	// enumerates all active uniforms of the linked program. Arrays are stored under their
+	// plain name and under every element name, block members have no location and are skipped.
+	// ------------------------------------------------------------------------
+	void reflectUniforms()
+	{
+		GLint count = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		GLchar name[256];
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type;
+			glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+
+			GLint location = glGetUniformLocation(ID, name);
+			if (location == -1)
+				continue;
+
+			std::string baseName(name, length);
+			if (size > 1 || (length > 3 && baseName.compare(length - 3, 3, "[0]") == 0))
+			{
+				baseName = baseName.substr(0, baseName.find('['));
+				uniforms.push_back({ baseName, location });
+				for (GLint element = 0; element < size; element++)
+				{
+					std::string elementName = baseName + "[" + std::to_string(element) + "]";
+					uniforms.push_back({ elementName, glGetUniformLocation(ID, elementName.c_str()) });
+				}
+			}
+			else
+				uniforms.push_back({ baseName, location });
+		}
+		std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo& a, const UniformInfo& b) { return a.name < b.name; });
+	}
+
+	// replaces every line of the form #include "file" with the contents of assets/shaders/file
+	// ------------------------------------------------------------------------
+	static std::string resolveIncludes(const std::string &code)
+	{
+		std::stringstream result;
+		std::istringstream lines(code);
+		std::string line;
+		while (std::getline(lines, line))
+		{
+			size_t first = line.find('"');
+			size_t last = line.rfind('"');
+			if (line.compare(0, 8, "#include") == 0 && first != std::string::npos && last > first)
+			{
+				std::ifstream includeFile("assets/shaders/" + line.substr(first + 1, last - first - 1));
+				if (includeFile.is_open())
+					result << includeFile.rdbuf() << "\n";
+				else
+					std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND " << line << std::endl;
+			}
+			else
+				result << line << "\n";
+		}
+		return result.str();
+	}
+
 	// utility function for checking shader compilation/linking errors.
 	// ------------------------------------------------------------------------
 	void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Camera.h"
+#include "Level.h"
+#include "TripleBuffer.h"
+
+/*!
+ * A key press, stamped with the time it was polled on the clock of the simulation
+ */
+struct InputEvent {
+	double time;
+	int key;
+};
+
+/*!
+ * Immutable game state after one simulation tick, everything the render thread needs to draw a frame and its HUD
+ */
+struct FrameSnapshot {
+	/*!
+	 * Simulation time at the end of the tick in seconds
+	 */
+	double time;
+	unsigned int tick;
+
+	glm::vec3 cameraPosition;
+
+	/*!
+	 * Offset of the moving cube from its start position along x
+	 */
+	float movingObjectX;
+
+	/*!
+	 * 1 right after the runner was hit, fading to 0
+	 */
+	float damageFactor;
+
+	int life;
+	int score;
+
+	/*!
+	 * Number of hits that play the damage sound, the render thread plays it when the count changes
+	 */
+	unsigned int damageSounds;
+
+	/*!
+	 * Number of key presses applied up to this tick, for measuring the latency from a key press to the frame that shows it
+	 */
+	unsigned int appliedInput;
+
+	bool paused;
+	bool room;
+	bool won;
+
+	/*!
+	 * The camera jumped during the tick, e.g. on a reset, and must not be interpolated from the tick before
+	 */
+	bool cut;
+
+	/*!
+	 * Blends the continuous values of two consecutive snapshots, the discrete ones are taken from the later one
+	 * @param alpha: 0 for from, 1 for to
+	 */
+	static FrameSnapshot interpolate(const FrameSnapshot& from, const FrameSnapshot& to, float alpha);
+};
+
+/*!
+ * The last two snapshots, published together so the render thread always interpolates between consecutive ticks
+ */
+struct SnapshotPair {
+	FrameSnapshot previous;
+	FrameSnapshot current;
+};
+
+/*!
+ * Game logic at a fixed rate on its own thread: camera movement, collision, life, score and the moving cube
+ *
+ * Every tick ends with a FrameSnapshot that is handed to the render thread through a lock-free triple buffer,
+ * so a slow GPU frame does not delay collision and input, and the render thread never waits for game logic.
+ * Key presses are posted with the time they were polled and applied at that time within their tick:
+ * the tick is split, so a lane change takes effect between the collision tests before and after it.
+ */
+class Simulation
+{
+protected:
+	/*!
+	 * Time the background fades from red back to blue after a hit
+	 */
+	static const double DAMAGE_FADE;
+
+	/*!
+	 * Time without damage before another hit plays the damage sound again
+	 */
+	static const double DAMAGE_SOUND_GAP;
+
+	Level& _level;
+	Camera _camera;
+
+	int _life;
+	int _score;
+	bool _paused;
+	bool _room;
+	double _timeSinceDamage;
+	unsigned int _damageSounds;
+
+	/*!
+	 * The moving cube goes back and forth, the direction flips at +-20
+	 */
+	float _movingObjectPhase;
+	int _movingObjectDirection;
+	float _movingObjectX;
+
+	unsigned int _tick;
+	bool _cut;
+
+	std::mutex _inputMutex;
+	std::vector<InputEvent> _input;
+
+	/*!
+	 * Posted key presses that were taken from _input and are not due yet, only used by the simulation
+	 */
+	std::vector<InputEvent> _pendingInput;
+	unsigned int _appliedInput;
+
+	TripleBuffer<SnapshotPair> _snapshots;
+	FrameSnapshot _last;
+
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::chrono::steady_clock::time_point _epoch;
+
+	void handleKey(int key);
+
+	/*!
+	 * Advances movement, collision, damage and the moving cube
+	 * @param delta: time in seconds, at most one tick
+	 */
+	void advance(float delta);
+
+	/*!
+	 * Advances the game by one tick, applying the key presses of the tick at their time, and publishes the snapshot
+	 */
+	void step();
+	void publish();
+	void run();
+
+public:
+	/*!
+	 * Ticks per second
+	 */
+	static const int TICK_RATE = 120;
+
+	/*!
+	 * @param level: the level, the render thread may only call its const functions while the simulation runs
+	 * @param camera: start position and settings of the camera
+	 */
+	Simulation(Level& level, const Camera& camera);
+	~Simulation();
+
+	Simulation(const Simulation&) = delete;
+	Simulation& operator=(const Simulation&) = delete;
+
+	/*!
+	 * Starts the simulation thread, the clock starts at 0
+	 */
+	void start();
+	void stop();
+
+	/*!
+	 * Runs all ticks up to a point in time on the calling thread, for benchmark runs that have to be deterministic
+	 * @param time: simulation time in seconds
+	 */
+	void advanceTo(double time);
+
+	/*!
+	 * @return seconds since start(), the time base of the snapshots and key presses, the simulated time if it was not started
+	 */
+	double clock() const;
+
+	/*!
+	 * Queues a key press, called by the thread that polls the window
+	 * @param event: the key and the time it was polled, see clock()
+	 */
+	void post(const InputEvent& event);
+
+	/*!
+	 * Takes the latest snapshots and interpolates them, never blocks
+	 * The render thread draws one tick behind the simulation, so it blends the last two ticks
+	 * @param time: render time on the clock of the simulation
+	 */
+	FrameSnapshot snapshot(double time);
+};
+
+const double Simulation::DAMAGE_FADE = 50.0 / 60.0;
+const double Simulation::DAMAGE_SOUND_GAP = 2.0 / 60.0;
+
+FrameSnapshot FrameSnapshot::interpolate(const FrameSnapshot& from, const FrameSnapshot& to, float alpha)
+{
+	FrameSnapshot frame = to;
+	if (to.cut)
+		return frame;
+
+	frame.time = from.time + (to.time - from.time) * alpha;
+	frame.cameraPosition = glm::mix(from.cameraPosition, to.cameraPosition, alpha);
+	frame.movingObjectX = glm::mix(from.movingObjectX, to.movingObjectX, alpha);
+	frame.damageFactor = glm::mix(from.damageFactor, to.damageFactor, alpha);
+	return frame;
+}
+
+Simulation::Simulation(Level& level, const Camera& camera)
+	: _level(level), _camera(camera), _life(196), _score(0), _paused(true), _room(false), _timeSinceDamage(DAMAGE_FADE),
+	_damageSounds(0), _movingObjectPhase(0.5f), _movingObjectDirection(1), _movingObjectX(0.0f), _tick(0), _cut(true), _appliedInput(0), _running(false)
+{
+	// both snapshots start as the initial state, so the first frames have something to draw
+	publish();
+	_cut = false;
+}
+
+Simulation::~Simulation()
+{
+	stop();
+}
+
+void Simulation::start()
+{
+	if (_running) return;
+
+	_epoch = std::chrono::steady_clock::now();
+	_running = true;
+	_thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+	if (!_running) return;
+
+	_running = false;
+	_thread.join();
+}
+
+double Simulation::clock() const
+{
+	if (!_running)
+		return _tick / (double)TICK_RATE;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - _epoch).count();
+}
+
+void Simulation::run()
+{
+	std::chrono::duration<double> tickDuration(1.0 / TICK_RATE);
+	std::chrono::steady_clock::time_point next = _epoch;
+	while (_running) {
+		// a tick runs once its end has passed, so all key presses within it are posted
+		// ticks that are overdue, e.g. after the thread was descheduled, are caught up at once
+		next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(tickDuration);
+		std::this_thread::sleep_until(next);
+		step();
+	}
+}
+
+void Simulation::advanceTo(double time)
+{
+	while ((_tick + 1) / (double)TICK_RATE <= time)
+		step();
+}
+
+void Simulation::post(const InputEvent& event)
+{
+	std::lock_guard<std::mutex> lock(_inputMutex);
+	_input.push_back(event);
+}
+
+void Simulation::handleKey(int key)
+{
+	float tick = 1.0f / TICK_RATE;
+	switch (key)
+	{
+	case GLFW_KEY_LEFT_SHIFT:
+		_camera.MovementSpeed += 1.0f;
+		break;
+	case GLFW_KEY_W:
+		_camera.ProcessKeyboard(FORWARD, tick);
+		break;
+	case GLFW_KEY_S:
+		_camera.ProcessKeyboard(BACKWARD, tick);
+		break;
+	case GLFW_KEY_A:
+		_camera.ProcessKeyboard(LEFT, tick);
+		break;
+	case GLFW_KEY_D:
+		_camera.ProcessKeyboard(RIGHT, tick);
+		break;
+	case GLFW_KEY_SPACE:
+		_paused = !_paused;
+		break;
+	case GLFW_KEY_PRINT_SCREEN:
+		_camera.ProcessKeyboard(RESET, tick);
+		_paused = true;
+		_room = !_room;
+		_cut = true;
+		break;
+	case GLFW_KEY_R:
+		_level.reset();
+		_life = 196;
+		_paused = true;
+		_room = false;
+		_camera.ProcessKeyboard(RESET, tick);
+		_cut = true;
+		break;
+	}
+}
+
+void Simulation::advance(float delta)
+{
+	if (delta <= 0.0f) return;
+
+	if (!_paused)
+		_camera.ProcessKeyboard(FORWARD, delta);
+
+	// damage depends on the time the runner spends in an obstacle, not on the tick rate
+	_timeSinceDamage += delta;
+	double damage = _level.collision(_camera, delta);
+	_life -= damage;
+	if (damage > 0) {
+		if (_timeSinceDamage > DAMAGE_SOUND_GAP)
+			_damageSounds++;
+		_timeSinceDamage = 0.0;
+	}
+
+	if (_life <= 0) {
+		_level.reset();
+		_camera.ProcessKeyboard(RESET, delta);
+		_paused = true;
+		_life = 200;
+		_cut = true;
+	}
+
+	// the cube moves 0.6 units per second and turns around every 400 / 60 seconds
+	if (_movingObjectPhase >= 20.0f)
+		_movingObjectDirection = -1;
+	else if (_movingObjectPhase <= -20.0f)
+		_movingObjectDirection = 1;
+	_movingObjectPhase += _movingObjectDirection * 6.0f * delta;
+	_movingObjectX += _movingObjectDirection * 0.6f * delta;
+}
+
+void Simulation::step()
+{
+	{
+		std::lock_guard<std::mutex> lock(_inputMutex);
+		_pendingInput.insert(_pendingInput.end(), _input.begin(), _input.end());
+		_input.clear();
+	}
+
+	// key presses that were posted too late for their tick are applied at the start of this one
+	double start = _tick / (double)TICK_RATE;
+	double end = (_tick + 1) / (double)TICK_RATE;
+	double time = start;
+	size_t due = 0;
+	for (; due < _pendingInput.size() && _pendingInput[due].time <= end; due++) {
+		const InputEvent& event = _pendingInput[due];
+		if (event.time > time) {
+			advance((float)(event.time - time));
+			time = event.time;
+		}
+		handleKey(event.key);
+		_appliedInput++;
+	}
+	_pendingInput.erase(_pendingInput.begin(), _pendingInput.begin() + due);
+	advance((float)(end - time));
+
+	_tick++;
+	publish();
+	_cut = false;
+}
+
+void Simulation::publish()
+{
+	FrameSnapshot snapshot;
+	snapshot.time = _tick / (double)TICK_RATE;
+	snapshot.tick = _tick;
+	snapshot.cameraPosition = _camera.Position;
+	snapshot.movingObjectX = _movingObjectX;
+	snapshot.damageFactor = 1.0f - (float)std::min(_timeSinceDamage / DAMAGE_FADE, 1.0);
+	snapshot.life = _life;
+	snapshot.score = _score;
+	snapshot.damageSounds = _damageSounds;
+	snapshot.appliedInput = _appliedInput;
+	snapshot.paused = _paused;
+	snapshot.room = _room;
+	snapshot.won = _level.win();
+	snapshot.cut = _cut;
+
+	SnapshotPair& pair = _snapshots.back();
+	pair.previous = _tick > 0 ? _last : snapshot;
+	pair.current = snapshot;
+	_snapshots.publish();
+	_last = snapshot;
+}
+
+FrameSnapshot Simulation::snapshot(double time)
+{
+	_snapshots.consume();
+	const SnapshotPair& pair = _snapshots.front();
+
+	float alpha = (float)((time - pair.current.time) * TICK_RATE);
+	return FrameSnapshot::interpolate(pair.previous, pair.current, glm::clamp(alpha, 0.0f, 1.0f));
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Geometry.h"
+
+/*!
+ * A chunk of the terrain, i.e. one copy of the shared chunk grid placed along the track
+ */
+struct TerrainChunk {
+	/*!
+	 * Position of the chunk along the track, the chunk covers z from index * length to (index + 1) * length
+	 */
+	int index;
+};
+
+/*!
+ * Terrain that streams fixed-size chunks around the camera
+ *
+ * The chunks are held in a ring buffer: chunk k always lives in slot k mod size, so when the camera moves
+ * on, the slots of the chunks behind it are recycled for the chunks coming into view. All chunks share
+ * one grid geometry, the height is computed from the world position in the vertex shader, so adjacent
+ * chunks meet without cracks. Memory and vertex work only depend on the view distance, not on the
+ * length of the track.
+ *
+ * Chunks further away are drawn with coarser grids (CDLOD): level l has a vertex every 2^l units. Towards
+ * the end of its range a level morphs its odd vertices onto the grid of the next level in the vertex
+ * shader, so where a chunk meets a coarser neighbour both have the same vertices and nothing pops.
+ * The morph only depends on the z distance of a vertex to the camera, which both chunks of an edge share.
+ */
+class Terrain
+{
+protected:
+	/*!
+	 * Number of detail levels, the grid of level l has a vertex every 2^l units
+	 */
+	static const int LOD_COUNT = 4;
+
+	/*!
+	 * Grid of every level, shared by all chunks of that level
+	 */
+	std::unique_ptr<Geometry> _grids[LOD_COUNT];
+
+	/*!
+	 * Distance from the camera at which level l ends and level l + 1 begins
+	 * Level l morphs to level l + 1 over the last _morphLength units before it
+	 */
+	float _lodDistance[LOD_COUNT - 1];
+	float _morphLength;
+
+	/*!
+	 * Uniforms of the terrain shader that control the morph
+	 */
+	Shader* _shader;
+	Uniform<float> _lodStepUniform;
+	Uniform<glm::vec2> _morphRangeUniform;
+
+	/*!
+	 * Ring buffer of the chunks
+	 */
+	std::vector<TerrainChunk> _chunks;
+
+	/*!
+	 * Position of the left edge and height of the terrain
+	 */
+	float _x, _y;
+
+	/*!
+	 * Length of a chunk along z
+	 */
+	int _chunkLength;
+
+	/*!
+	 * Distance the terrain extends in front of the camera
+	 */
+	float _viewDistance;
+
+	/*!
+	 * Distance the terrain extends behind the camera
+	 */
+	float _behindDistance;
+
+	/*!
+	 * Indices of the first and last chunk in range, set by update()
+	 */
+	int _first, _last;
+
+	/*!
+	 * Returns the index of the chunk that contains a z coordinate
+	 */
+	int chunkIndex(float z) const;
+
+	/*!
+	 * Returns the detail level of a chunk, selected by the distance of its nearest edge to the camera
+	 */
+	int chunkLod(const TerrainChunk& chunk, float cameraZ) const;
+
+	/*!
+	 * z coordinate of the camera, set by update()
+	 */
+	float _cameraZ;
+
+public:
+	/*!
+	 * Terrain constructor
+	 * @param material: material of the terrain
+	 * @param width: number of quads across the track, has to be a multiple of 2^(LOD_COUNT - 1)
+	 * @param chunkLength: number of quads of a chunk along the track, has to be a multiple of 2^(LOD_COUNT - 1)
+	 * @param viewDistance: distance the terrain extends in front of the camera, i.e. the far plane
+	 * @param behindDistance: distance the terrain extends behind the camera
+	 * @param x: position of the left edge of the terrain
+	 * @param y: height of the terrain
+	 */
+	Terrain(Material* material, int width, int chunkLength, float viewDistance, float behindDistance, float x, float y);
+
+	/*!
+	 * Recycles the chunks that fell out of range for the chunks that came into range
+	 * The camera looks along -z, so the chunks in front of it have smaller z
+	 * @param cameraZ: z coordinate of the camera
+	 */
+	void update(float cameraZ);
+
+	/*!
+	 * Draws all chunks, each with the grid of its detail level
+	 */
+	void draw();
+};
+
+Terrain::Terrain(Material* material, int width, int chunkLength, float viewDistance, float behindDistance, float x, float y)
+	: _shader(material->getShader()), _x(x), _y(y), _chunkLength(chunkLength), _viewDistance(viewDistance), _behindDistance(behindDistance),
+	_first(0), _last(-1), _cameraZ(0.0f)
+{
+	for (int lod = 0; lod < LOD_COUNT; lod++) {
+		int step = 1 << lod;
+		GeometryData data = Geometry::createPlaneGeometry(width / step + 1, chunkLength / step + 1);
+		for (glm::vec3& position : data.positions)
+			position *= (float)step;
+		_grids[lod].reset(new Geometry(glm::mat4(1.0f), data, material));
+	}
+
+	// two neighbouring chunks must never be more than one level apart, and a chunk edge next to a coarser
+	// chunk must lie where the finer level is fully morphed and the coarser level has not started morphing
+	// yet: this holds if consecutive level distances are at least one chunk plus the morph length apart
+	_morphLength = chunkLength * 0.25f;
+	_lodDistance[0] = 16.0f;
+	for (int lod = 1; lod < LOD_COUNT - 1; lod++)
+		_lodDistance[lod] = _lodDistance[lod - 1] + chunkLength + _morphLength;
+
+	_lodStepUniform = _shader->getUniform<float>("lodStep");
+	_morphRangeUniform = _shader->getUniform<glm::vec2>("morphRange");
+
+	// enough slots for every chunk the range can touch, the range rarely starts on a chunk border
+	int count = (int)std::ceil((viewDistance + behindDistance) / chunkLength) + 1;
+
+	// no chunk is valid until the first update
+	TerrainChunk empty = { INT_MIN };
+	_chunks.assign(count, empty);
+}
+
+int Terrain::chunkIndex(float z) const
+{
+	return (int)std::floor(z / _chunkLength);
+}
+
+int Terrain::chunkLod(const TerrainChunk& chunk, float cameraZ) const
+{
+	float start = (float)(chunk.index * _chunkLength);
+	float end = start + _chunkLength;
+	float distance = std::max(0.0f, std::max(start - cameraZ, cameraZ - end));
+
+	int lod = 0;
+	while (lod < LOD_COUNT - 1 && distance >= _lodDistance[lod])
+		lod++;
+	return lod;
+}
+
+void Terrain::update(float cameraZ)
+{
+	_cameraZ = cameraZ;
+	_first = chunkIndex(cameraZ - _viewDistance);
+	_last = chunkIndex(cameraZ + _behindDistance);
+	int count = (int)_chunks.size();
+
+	// a slot whose chunk is out of range is taken over by the chunk of the same slot that is in range
+	for (int index = _first; index <= _last; index++)
+		_chunks[((index % count) + count) % count].index = index;
+}
+
+void Terrain::draw()
+{
+	_shader->use();
+
+	for (const TerrainChunk& chunk : _chunks) {
+		if (chunk.index < _first || chunk.index > _last) continue;
+
+		int lod = chunkLod(chunk, _cameraZ);
+		_shader->set(_lodStepUniform, (float)(1 << lod));
+		if (lod < LOD_COUNT - 1)
+			_shader->set(_morphRangeUniform, glm::vec2(_lodDistance[lod] - _morphLength, _lodDistance[lod]));
+		else
+			_shader->set(_morphRangeUniform, glm::vec2(1e30f, 2e30f));
+
+		Geometry& grid = *_grids[lod];
+		grid.resetModelMatrix();
+		grid.transform(glm::translate(glm::mat4(1.0f), glm::vec3(_x, _y, (float)(chunk.index * _chunkLength))));
+		grid.draw();
+	}
+}
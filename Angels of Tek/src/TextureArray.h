@@ -0,0 +1,410 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "GLState.h"
+#include "TextureCompression.h"
+
+/*!
+ * 2D texture array with immutable storage, every layer has the same size and format
+ * Images of a different size are resampled to the size of the array when they are loaded
+ * Compressed arrays store one, two and three channels as BC4, BC5 and BC1 with mip chains built on the CPU
+ */
+class TextureArray
+{
+protected:
+	/*!
+	 * Texture handle
+	 */
+	GLuint _handle;
+
+	/*!
+	 * Size of every layer in texels
+	 */
+	GLsizei _width, _height;
+
+	/*!
+	 * Number of layers
+	 */
+	GLsizei _layers;
+
+	/*!
+	 * Number of color channels per texel (1 to 4)
+	 */
+	int _channels;
+
+	/*!
+	 * Number of mip levels
+	 */
+	GLsizei _levels;
+
+	TextureCompression _compression;
+
+	static GLenum internalFormat(int channels);
+
+	/*!
+	 * Uploads all levels of a layer, laid out as built by BlockCompression::buildLevels()
+	 */
+	void uploadLevels(GLsizei layer, const std::vector<unsigned char>& levels, const std::vector<size_t>& levelOffsets);
+
+	/*!
+	 * Uploads an image of the size and channels of the array into a layer, compressing it if the array is compressed
+	 */
+	void uploadImage(GLsizei layer, const std::vector<unsigned char>& pixels);
+
+public:
+	/*!
+	 * Texture array constructor
+	 * Allocates storage for all layers including the full mip chain, every level of every layer starts out
+	 * filled with the placeholder color until an image is loaded into it
+	 * @param width: width of every layer
+	 * @param height: height of every layer
+	 * @param layers: number of layers
+	 * @param channels: number of color channels per texel (1 to 4)
+	 * @param placeholder: color of the layers without an image, only the first channels are used
+	 * @param compressed: whether to block-compress the array, ignored for four channels or if the driver lacks the format
+	 */
+	TextureArray(GLsizei width, GLsizei height, GLsizei layers, int channels, glm::u8vec4 placeholder = glm::u8vec4(255), bool compressed = false);
+	~TextureArray();
+
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	/*!
+	 * Loads an image file into a layer, resampling it if its size differs from the array
+	 * Compressed arrays get all levels of the layer, uncompressed ones only the first until generateMipmaps()
+	 * @param layer: index of the layer
+	 * @param path: path of the image file
+	 * @return whether the image could be loaded
+	 */
+	bool loadLayer(GLsizei layer, const char* path);
+
+	/*!
+	 * Packs one image file per channel into a layer, see loadPackedImage()
+	 * @param layer: index of the layer
+	 * @param channelPaths: path of the image file of every channel of the array
+	 * @return whether all images could be loaded
+	 */
+	bool loadLayer(GLsizei layer, const std::vector<std::string>& channelPaths);
+
+	/*!
+	 * Builds the mip chain of all layers, call once after all layers are loaded
+	 * Does nothing for compressed arrays, their layers are loaded with all levels
+	 */
+	void generateMipmaps();
+
+	/*!
+	 * Binds the array to a texture unit
+	 * @param unit: index of the texture unit
+	 */
+	void bind(GLuint unit) const;
+
+	GLuint handle() const;
+	GLsizei width() const;
+	GLsizei height() const;
+	GLsizei layers() const;
+	GLsizei levels() const;
+	int channels() const;
+	TextureCompression compression() const;
+
+	/*!
+	 * Loads an image file, two channels are red and green rather than grey and alpha as in stb_image
+	 * @param path: path of the image file
+	 * @param channels: number of channels to convert to, 0 keeps those of the file and receives them
+	 * @param width: width to resample to, 0 keeps that of the file and receives it
+	 * @param height: height to resample to, 0 keeps that of the file and receives it
+	 * @param pixels: receives the tightly packed texels
+	 * @return whether the image could be loaded
+	 */
+	static bool loadImage(const char* path, int& channels, int& width, int& height, std::vector<unsigned char>& pixels);
+
+	/*!
+	 * Loads single channel image files into the channels of one image, e.g. occlusion, roughness and metallic maps
+	 * The first channel of every file is used, all files are resampled to the size of the first
+	 * @param paths: path of the image file of every channel
+	 * @param width: width to resample to, 0 keeps that of the first file and receives it
+	 * @param height: height to resample to, 0 keeps that of the first file and receives it
+	 * @param pixels: receives the tightly packed texels
+	 * @return whether all images could be loaded
+	 */
+	static bool loadPackedImage(const std::vector<std::string>& paths, int& width, int& height, std::vector<unsigned char>& pixels);
+
+	/*!
+	 * @return the client pixel format of images with a number of channels (1 to 4)
+	 */
+	static GLenum pixelFormat(int channels);
+
+	/*!
+	 * Bilinearly resamples an image to a new size
+	 */
+	static std::vector<unsigned char> resample(const unsigned char* source, int sourceWidth, int sourceHeight, int channels, int width, int height);
+};
+
+TextureArray::TextureArray(GLsizei width, GLsizei height, GLsizei layers, int channels, glm::u8vec4 placeholder, bool compressed)
+	: _width(width), _height(height), _layers(layers), _channels(channels), _compression(TextureCompression::NONE)
+{
+	_levels = 1 + (GLsizei)std::floor(std::log2((float)std::max(width, height)));
+
+	if (compressed && BlockCompression::isSupported(BlockCompression::forChannels(channels)))
+		_compression = BlockCompression::forChannels(channels);
+
+	glGenTextures(1, &_handle);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	GLenum format = _compression != TextureCompression::NONE ? BlockCompression::internalFormat(_compression) : internalFormat(channels);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, _levels, format, width, height, layers);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	// fill all levels of every layer, so a layer whose image is missing or not loaded yet does not sample undefined memory
+	// a compressed fill is one block of the placeholder repeated
+	std::vector<unsigned char> fill;
+	if (_compression != TextureCompression::NONE) {
+		std::vector<unsigned char> texels(16 * channels);
+		for (size_t i = 0; i < texels.size(); i++)
+			texels[i] = placeholder[i % channels];
+		std::vector<unsigned char> block = BlockCompression::compress(_compression, texels.data(), 4, 4, channels);
+		size_t size = BlockCompression::compressedSize(_compression, width, height);
+		for (size_t offset = 0; offset < size; offset += block.size())
+			fill.insert(fill.end(), block.begin(), block.end());
+	}
+	else {
+		fill.resize((size_t)width * height * channels);
+		for (size_t i = 0; i < fill.size(); i++)
+			fill[i] = placeholder[i % channels];
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (GLsizei level = 0; level < _levels; level++) {
+		GLsizei levelWidth = std::max(1, width >> level);
+		GLsizei levelHeight = std::max(1, height >> level);
+		for (GLsizei layer = 0; layer < layers; layer++) {
+			if (_compression != TextureCompression::NONE)
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1, format,
+					(GLsizei)BlockCompression::compressedSize(_compression, levelWidth, levelHeight), fill.data());
+			else
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1, pixelFormat(channels), GL_UNSIGNED_BYTE, fill.data());
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray::~TextureArray()
+{
+	glState.deleteTexture(_handle);
+}
+
+GLenum TextureArray::internalFormat(int channels)
+{
+	switch (channels) {
+	case 1: return GL_R8;
+	case 2: return GL_RG8;
+	case 3: return GL_RGB8;
+	default: return GL_RGBA8;
+	}
+}
+
+GLenum TextureArray::pixelFormat(int channels)
+{
+	switch (channels) {
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	default: return GL_RGBA;
+	}
+}
+
+std::vector<unsigned char> TextureArray::resample(const unsigned char* source, int sourceWidth, int sourceHeight, int channels, int width, int height)
+{
+	std::vector<unsigned char> result((size_t)width * height * channels);
+
+	for (int y = 0; y < height; y++) {
+		// sample at texel centers so both images cover the same area
+		float sy = std::min(std::max((y + 0.5f) * sourceHeight / height - 0.5f, 0.0f), sourceHeight - 1.0f);
+		int y0 = (int)sy;
+		int y1 = std::min(y0 + 1, sourceHeight - 1);
+		float fy = sy - y0;
+
+		for (int x = 0; x < width; x++) {
+			float sx = std::min(std::max((x + 0.5f) * sourceWidth / width - 0.5f, 0.0f), sourceWidth - 1.0f);
+			int x0 = (int)sx;
+			int x1 = std::min(x0 + 1, sourceWidth - 1);
+			float fx = sx - x0;
+
+			for (int c = 0; c < channels; c++) {
+				float top = source[(y0 * sourceWidth + x0) * channels + c] * (1.0f - fx) + source[(y0 * sourceWidth + x1) * channels + c] * fx;
+				float bottom = source[(y1 * sourceWidth + x0) * channels + c] * (1.0f - fx) + source[(y1 * sourceWidth + x1) * channels + c] * fx;
+				result[((size_t)y * width + x) * channels + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+
+	return result;
+}
+
+bool TextureArray::loadImage(const char* path, int& channels, int& width, int& height, std::vector<unsigned char>& pixels)
+{
+	// stb_image converts to grey and alpha for two channels, so those are loaded as RGB and the blue channel is dropped
+	int fileWidth, fileHeight, fileChannels;
+	unsigned char* data = stbi_load(path, &fileWidth, &fileHeight, &fileChannels, channels == 2 ? 3 : channels);
+	if (!data) return false;
+
+	if (channels == 0) channels = fileChannels;
+	if (width == 0) width = fileWidth;
+	if (height == 0) height = fileHeight;
+
+	size_t count = (size_t)fileWidth * fileHeight;
+	std::vector<unsigned char> texels(count * channels);
+	if (channels == 2) {
+		for (size_t i = 0; i < count; i++) {
+			texels[2 * i] = data[3 * i];
+			texels[2 * i + 1] = data[3 * i + 1];
+		}
+	}
+	else {
+		std::copy(data, data + texels.size(), texels.begin());
+	}
+	stbi_image_free(data);
+
+	if (fileWidth != width || fileHeight != height)
+		pixels = resample(texels.data(), fileWidth, fileHeight, channels, width, height);
+	else
+		pixels = std::move(texels);
+	return true;
+}
+
+void TextureArray::uploadLevels(GLsizei layer, const std::vector<unsigned char>& levels, const std::vector<size_t>& levelOffsets)
+{
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	for (GLsizei level = 0; level < (GLsizei)levelOffsets.size(); level++) {
+		GLsizei levelWidth = std::max(1, _width >> level);
+		GLsizei levelHeight = std::max(1, _height >> level);
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1, BlockCompression::internalFormat(_compression),
+			(GLsizei)BlockCompression::compressedSize(_compression, levelWidth, levelHeight), levels.data() + levelOffsets[level]);
+	}
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+bool TextureArray::loadPackedImage(const std::vector<std::string>& paths, int& width, int& height, std::vector<unsigned char>& pixels)
+{
+	int channels = (int)paths.size();
+	for (int channel = 0; channel < channels; channel++) {
+		int singleChannel = 1;
+		std::vector<unsigned char> single;
+		if (!loadImage(paths[channel].c_str(), singleChannel, width, height, single))
+			return false;
+
+		if (channel == 0)
+			pixels.resize(single.size() * channels);
+		for (size_t i = 0; i < single.size(); i++)
+			pixels[i * channels + channel] = single[i];
+	}
+	return channels > 0;
+}
+
+void TextureArray::uploadImage(GLsizei layer, const std::vector<unsigned char>& pixels)
+{
+	if (_compression != TextureCompression::NONE) {
+		std::vector<unsigned char> levels;
+		std::vector<size_t> levelOffsets;
+		BlockCompression::buildLevels(pixels.data(), _width, _height, _channels, _compression, levels, levelOffsets);
+		uploadLevels(layer, levels, levelOffsets);
+		return;
+	}
+
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, _width, _height, 1, pixelFormat(_channels), GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+bool TextureArray::loadLayer(GLsizei layer, const char* path)
+{
+	int channels = _channels, width = _width, height = _height;
+	std::vector<unsigned char> pixels;
+	if (!loadImage(path, channels, width, height, pixels)) {
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+		return false;
+	}
+
+	uploadImage(layer, pixels);
+	return true;
+}
+
+bool TextureArray::loadLayer(GLsizei layer, const std::vector<std::string>& channelPaths)
+{
+	int width = _width, height = _height;
+	std::vector<unsigned char> pixels;
+	if ((int)channelPaths.size() != _channels || !loadPackedImage(channelPaths, width, height, pixels)) {
+		std::cout << "Texture failed to load at paths:";
+		for (const std::string& path : channelPaths)
+			std::cout << " " << path;
+		std::cout << std::endl;
+		return false;
+	}
+
+	uploadImage(layer, pixels);
+	return true;
+}
+
+void TextureArray::generateMipmaps()
+{
+	if (_compression != TextureCompression::NONE) return;
+
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, _handle);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArray::bind(GLuint unit) const
+{
+	glState.bindTexture(unit, GL_TEXTURE_2D_ARRAY, _handle);
+}
+
+GLuint TextureArray::handle() const
+{
+	return _handle;
+}
+
+GLsizei TextureArray::width() const
+{
+	return _width;
+}
+
+GLsizei TextureArray::height() const
+{
+	return _height;
+}
+
+GLsizei TextureArray::layers() const
+{
+	return _layers;
+}
+
+GLsizei TextureArray::levels() const
+{
+	return _levels;
+}
+
+int TextureArray::channels() const
+{
+	return _channels;
+}
+
+TextureCompression TextureArray::compression() const
+{
+	return _compression;
+}
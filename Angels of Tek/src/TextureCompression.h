@@ -0,0 +1,355 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+/*!
+ * Storage format of a texture on the GPU
+ */
+enum class TextureCompression {
+	NONE,
+
+	/*!
+	 * RGB at 4 bits per texel: two RGB565 endpoints and a 2-bit index per texel
+	 */
+	BC1,
+
+	/*!
+	 * One channel at 4 bits per texel: two 8-bit endpoints and a 3-bit index per texel
+	 */
+	BC4,
+
+	/*!
+	 * Two channels at 8 bits per texel, two BC4 blocks, used for normal maps (z is reconstructed in the shader)
+	 */
+	BC5
+};
+
+/*!
+ * Block compression encoders and mip chain generation for textures
+ *
+ * The encoders fit the endpoints to the range of a block along its principal axis and pick the closest
+ * palette entry per texel. That is far from the quality of offline compressors, but fast enough to
+ * transcode all textures on the first launch, after which the compressed chains are read from the cache.
+ */
+class BlockCompression
+{
+protected:
+	static uint16_t packRgb565(const float color[3]);
+	static void unpackRgb565(uint16_t packed, float color[3]);
+
+	/*!
+	 * Copies the 4x4 block at (x, y), texels past the edge of the image repeat the last row or column
+	 */
+	static void fetchBlock(const unsigned char* pixels, int width, int height, int channels, int x, int y, unsigned char block[16][4]);
+
+	static void encodeBC1(const unsigned char block[16][4], unsigned char* out);
+	static void encodeBC4(const unsigned char block[16][4], int channel, unsigned char* out);
+
+public:
+	/*!
+	 * @return the compression used for images with a number of channels, NONE for four channels
+	 */
+	static TextureCompression forChannels(int channels);
+
+	/*!
+	 * @return the OpenGL internal format of a compression
+	 */
+	static GLenum internalFormat(TextureCompression compression);
+
+	/*!
+	 * @return whether the driver supports a compression, BC4 and BC5 are core but BC1 is an extension
+	 */
+	static bool isSupported(TextureCompression compression);
+
+	/*!
+	 * @return the number of bytes of a compressed image
+	 */
+	static size_t compressedSize(TextureCompression compression, int width, int height);
+
+	/*!
+	 * Compresses an image
+	 * @param compression: the format, not NONE
+	 * @param pixels: tightly packed 8-bit texels
+	 * @param channels: number of channels of the pixels, has to match the format
+	 * @return the blocks, row by row
+	 */
+	static std::vector<unsigned char> compress(TextureCompression compression, const unsigned char* pixels, int width, int height, int channels);
+
+	/*!
+	 * Halves an image with a box filter, odd edges repeat their last texel
+	 */
+	static void downsample(const unsigned char* source, int width, int height, int channels, unsigned char* target);
+
+	/*!
+	 * Builds the full mip chain of an image and compresses every level
+	 * @param pixels: level 0, tightly packed 8-bit texels
+	 * @param compression: format of the levels, NONE keeps the texels
+	 * @param levels: receives all levels one after another
+	 * @param levelOffsets: receives the offset of every level in levels
+	 */
+	static void buildLevels(const unsigned char* pixels, int width, int height, int channels, TextureCompression compression,
+		std::vector<unsigned char>& levels, std::vector<size_t>& levelOffsets);
+};
+
+TextureCompression BlockCompression::forChannels(int channels)
+{
+	switch (channels) {
+	case 1: return TextureCompression::BC4;
+	case 2: return TextureCompression::BC5;
+	case 3: return TextureCompression::BC1;
+	default: return TextureCompression::NONE;
+	}
+}
+
+GLenum BlockCompression::internalFormat(TextureCompression compression)
+{
+	switch (compression) {
+	case TextureCompression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TextureCompression::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TextureCompression::BC5: return GL_COMPRESSED_RG_RGTC2;
+	default: return GL_NONE;
+	}
+}
+
+bool BlockCompression::isSupported(TextureCompression compression)
+{
+	if (compression != TextureCompression::BC1) return true;
+
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != nullptr && std::strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+			return true;
+	}
+	return false;
+}
+
+size_t BlockCompression::compressedSize(TextureCompression compression, int width, int height)
+{
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	return blocks * (compression == TextureCompression::BC5 ? 16 : 8);
+}
+
+uint16_t BlockCompression::packRgb565(const float color[3])
+{
+	int r = (int)std::round(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+	int g = (int)std::round(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+	int b = (int)std::round(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void BlockCompression::unpackRgb565(uint16_t packed, float color[3])
+{
+	color[0] = ((packed >> 11) & 31) * 255.0f / 31.0f;
+	color[1] = ((packed >> 5) & 63) * 255.0f / 63.0f;
+	color[2] = (packed & 31) * 255.0f / 31.0f;
+}
+
+void BlockCompression::fetchBlock(const unsigned char* pixels, int width, int height, int channels, int x, int y, unsigned char block[16][4])
+{
+	for (int by = 0; by < 4; by++) {
+		int py = std::min(y + by, height - 1);
+		for (int bx = 0; bx < 4; bx++) {
+			int px = std::min(x + bx, width - 1);
+			const unsigned char* texel = pixels + ((size_t)py * width + px) * channels;
+			for (int c = 0; c < 4; c++)
+				block[by * 4 + bx][c] = c < channels ? texel[c] : 0;
+		}
+	}
+}
+
+void BlockCompression::encodeBC1(const unsigned char block[16][4], unsigned char* out)
+{
+	// principal axis of the colors by power iteration on their covariance
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += block[i][c] / 16.0f;
+
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if (length < 1e-6f) break;
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+
+	// the extremes along the axis become the endpoints
+	float minProjection = 1e30f, maxProjection = -1e30f;
+	int minIndex = 0, maxIndex = 0;
+	for (int i = 0; i < 16; i++) {
+		float projection = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+		if (projection < minProjection) { minProjection = projection; minIndex = i; }
+		if (projection > maxProjection) { maxProjection = projection; maxIndex = i; }
+	}
+
+	float high[3] = { (float)block[maxIndex][0], (float)block[maxIndex][1], (float)block[maxIndex][2] };
+	float low[3] = { (float)block[minIndex][0], (float)block[minIndex][1], (float)block[minIndex][2] };
+	uint16_t color0 = packRgb565(high);
+	uint16_t color1 = packRgb565(low);
+
+	// color0 > color1 selects the four color mode, equal endpoints only use index 0
+	if (color0 < color1) std::swap(color0, color1);
+
+	float palette[4][3];
+	unpackRgb565(color0, palette[0]);
+	unpackRgb565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestDistance = 1e30f;
+			for (int p = 0; p < 4; p++) {
+				float r = block[i][0] - palette[p][0], g = block[i][1] - palette[p][1], b = block[i][2] - palette[p][2];
+				float distance = r * r + g * g + b * b;
+				if (distance < bestDistance) { bestDistance = distance; best = p; }
+			}
+			indices |= (uint32_t)best << (2 * i);
+		}
+	}
+
+	out[0] = (unsigned char)(color0 & 0xff); out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)(color1 & 0xff); out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+void BlockCompression::encodeBC4(const unsigned char block[16][4], int channel, unsigned char* out)
+{
+	int high = 0, low = 255;
+	for (int i = 0; i < 16; i++) {
+		high = std::max(high, (int)block[i][channel]);
+		low = std::min(low, (int)block[i][channel]);
+	}
+
+	// endpoint0 > endpoint1 selects eight interpolated values, equal endpoints only use index 0
+	out[0] = (unsigned char)high;
+	out[1] = (unsigned char)low;
+
+	float palette[8] = { (float)high, (float)low };
+	for (int p = 1; p < 7; p++)
+		palette[p + 1] = ((7 - p) * high + p * low) / 7.0f;
+
+	uint64_t indices = 0;
+	if (high != low) {
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestDistance = 1e30f;
+			for (int p = 0; p < 8; p++) {
+				float distance = std::fabs(block[i][channel] - palette[p]);
+				if (distance < bestDistance) { bestDistance = distance; best = p; }
+			}
+			indices |= (uint64_t)best << (3 * i);
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+std::vector<unsigned char> BlockCompression::compress(TextureCompression compression, const unsigned char* pixels, int width, int height, int channels)
+{
+	std::vector<unsigned char> blocks(compressedSize(compression, width, height));
+	unsigned char* out = blocks.data();
+
+	unsigned char block[16][4];
+	for (int y = 0; y < height; y += 4) {
+		for (int x = 0; x < width; x += 4) {
+			fetchBlock(pixels, width, height, channels, x, y, block);
+			switch (compression) {
+			case TextureCompression::BC1:
+				encodeBC1(block, out);
+				out += 8;
+				break;
+			case TextureCompression::BC4:
+				encodeBC4(block, 0, out);
+				out += 8;
+				break;
+			case TextureCompression::BC5:
+				encodeBC4(block, 0, out);
+				encodeBC4(block, 1, out + 8);
+				out += 16;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	return blocks;
+}
+
+void BlockCompression::downsample(const unsigned char* source, int width, int height, int channels, unsigned char* target)
+{
+	int targetWidth = std::max(1, width / 2);
+	int targetHeight = std::max(1, height / 2);
+
+	for (int y = 0; y < targetHeight; y++) {
+		int y0 = std::min(2 * y, height - 1);
+		int y1 = std::min(2 * y + 1, height - 1);
+		for (int x = 0; x < targetWidth; x++) {
+			int x0 = std::min(2 * x, width - 1);
+			int x1 = std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < channels; c++) {
+				int sum = source[(y0 * width + x0) * channels + c] + source[(y0 * width + x1) * channels + c]
+					+ source[(y1 * width + x0) * channels + c] + source[(y1 * width + x1) * channels + c];
+				target[(y * targetWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void BlockCompression::buildLevels(const unsigned char* pixels, int width, int height, int channels, TextureCompression compression,
+	std::vector<unsigned char>& levels, std::vector<size_t>& levelOffsets)
+{
+	int count = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+	levels.clear();
+	levelOffsets.clear();
+
+	std::vector<unsigned char> current(pixels, pixels + (size_t)width * height * channels);
+	std::vector<unsigned char> next;
+	for (int level = 0; level < count; level++) {
+		int levelWidth = std::max(1, width >> level);
+		int levelHeight = std::max(1, height >> level);
+
+		levelOffsets.push_back(levels.size());
+		if (compression == TextureCompression::NONE) {
+			levels.insert(levels.end(), current.begin(), current.end());
+		}
+		else {
+			std::vector<unsigned char> blocks = compress(compression, current.data(), levelWidth, levelHeight, channels);
+			levels.insert(levels.end(), blocks.begin(), blocks.end());
+		}
+
+		if (level + 1 < count) {
+			next.resize((size_t)std::max(1, levelWidth / 2) * std::max(1, levelHeight / 2) * channels);
+			downsample(current.data(), levelWidth, levelHeight, channels, next.data());
+			std::swap(current, next);
+		}
+	}
+}
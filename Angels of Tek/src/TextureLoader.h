@@ -0,0 +1,656 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "DdsFile.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "TextureArray.h"
+#include "TextureCompression.h"
+
+/*!
+ * Timings of one texture in milliseconds since the loader was created
+ */
+struct TextureTiming {
+	std::string path;
+	double queued;
+	double decodeStart;
+	double decodeEnd;
+	double uploadStart;
+	double uploaded;
+	bool loaded;
+
+	/*!
+	 * Whether the compressed mip chain came from the cache instead of being transcoded
+	 */
+	bool cached;
+
+	/*!
+	 * Bytes of all levels on the GPU, and what they would take uncompressed
+	 */
+	size_t bytes;
+	size_t uncompressedBytes;
+
+	/*!
+	 * Number of textures and layers the image was uploaded to, an image shared by several is decoded once
+	 */
+	unsigned int targets;
+};
+
+/*!
+ * Loads textures in the background: image files are decoded on worker threads, including resampling and
+ * building the mip chain, and the main thread only copies the finished images into a pixel buffer object
+ * the driver uploads from. Until its image arrives a texture shows a placeholder color, so the first frame
+ * does not wait for any texture and all textures are ready after roughly the slowest decode.
+ *
+ * Compressed textures are transcoded once and their mip chains kept as DDS files in a cache directory,
+ * named by a hash of the image file and the conversion settings. Later launches read the chain from the
+ * cache and upload it as it is, without decoding, resampling or compressing anything.
+ */
+class TextureLoader
+{
+protected:
+	/*!
+	 * Texture an image is uploaded to: a layer of a texture array, or a whole 2D texture if layer is negative
+	 */
+	struct Target {
+		GLuint texture;
+		GLint layer;
+	};
+
+	/*!
+	 * One image to load, filled in by a worker
+	 */
+	struct Job {
+		std::string path;
+
+		/*!
+		 * Image file of every channel if the image is packed from single channel files, empty otherwise
+		 */
+		std::vector<std::string> channelPaths;
+
+		/*!
+		 * Every texture that gets the image, only used by the main thread, so targets can be added while a worker decodes
+		 */
+		std::vector<Target> targets;
+
+		/*!
+		 * sourceKey() of the job as it was queued, decode() changes the settings it is made of
+		 */
+		std::string key;
+
+		/*!
+		 * Size and channels the image is converted to, 0 keeps those of the file
+		 */
+		int width, height, channels;
+
+		/*!
+		 * Whether to block-compress the image, and the format chosen once the channels are known
+		 */
+		bool compress;
+		TextureCompression compression;
+
+		/*!
+		 * Index of the timings of the texture
+		 */
+		size_t timing;
+
+		/*!
+		 * Decoded image: all mip levels one after another, tightly packed or compressed
+		 */
+		bool loaded;
+		bool cached;
+		std::vector<unsigned char> pixels;
+		std::vector<size_t> levelOffsets;
+		double decodeStart, decodeEnd;
+	};
+
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _decoded;
+	bool _stop;
+
+	/*!
+	 * Jobs waiting for a worker and jobs waiting for their upload, shared with the workers
+	 */
+	std::deque<std::unique_ptr<Job>> _queue;
+	std::deque<std::unique_ptr<Job>> _done;
+
+	/*!
+	 * Number of jobs that are not uploaded yet, only used by the main thread
+	 */
+	size_t _pending;
+
+	/*!
+	 * Jobs that are not uploaded yet by their source and conversion settings, only used by the main thread
+	 * A request for an image that is already queued adds a target to that job instead of decoding it again
+	 */
+	std::unordered_map<std::string, Job*> _jobs;
+
+	/*!
+	 * Pixel buffer the images are uploaded from, orphaned for every image so the driver can keep reading the previous one
+	 */
+	GLuint _pbo;
+
+	/*!
+	 * Directory of the compressed mip chains, empty disables the cache
+	 */
+	std::string _cacheDirectory;
+
+	/*!
+	 * Whether the driver takes BC1, queried on the main thread as the workers have no context
+	 */
+	bool _bc1Supported;
+
+	std::vector<TextureTiming> _timings;
+	std::chrono::steady_clock::time_point _start;
+	double _firstUpdate;
+	bool _reported;
+
+	double now() const;
+	void workerLoop();
+	/*!
+	 * Queues a job, or adds its target to a queued job of the same image
+	 */
+	void enqueue(std::unique_ptr<Job> job);
+
+	/*!
+	 * Key of the image a job loads: its files and everything the conversion depends on
+	 */
+	static std::string sourceKey(const Job& job);
+
+	/*!
+	 * Decodes the image of a job and builds its mip chain, or reads it from the cache, runs on a worker
+	 */
+	void decode(Job& job) const;
+
+	/*!
+	 * Path of the cached mip chain of a job, empty if the file cannot be read
+	 */
+	std::string cachePath(const Job& job) const;
+
+	/*!
+	 * Uploads a decoded image, runs on the main thread
+	 */
+	void upload(Job& job);
+
+	static void makeDirectory(const std::string& path);
+
+public:
+	/*!
+	 * Changes whenever the encoders or the mip chain change, so cached chains of an older version are not used
+	 */
+	static const uint32_t CACHE_VERSION = 1;
+
+	/*!
+	 * Texture loader constructor, needs a current OpenGL context
+	 * @param threads: number of decode threads, 0 uses one less than the number of hardware threads
+	 * @param cacheDirectory: directory of the compressed mip chains, created if missing, empty disables the cache
+	 */
+	explicit TextureLoader(unsigned int threads = 0, const std::string& cacheDirectory = "assets/textures/cache");
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	/*!
+	 * Queues an image file for a layer of a texture array, the layer keeps its placeholder until the image is uploaded
+	 * @param array: the texture array, has to outlive the upload
+	 * @param layer: index of the layer
+	 * @param path: path of the image file
+	 */
+	void loadLayer(const TextureArray& array, GLint layer, const std::string& path);
+
+	/*!
+	 * Queues one image file per channel for a layer of a texture array, packed as in TextureArray::loadPackedImage()
+	 * The packed chain is cached like any other, so the files are only combined on the first launch
+	 * @param array: the texture array, has to outlive the upload
+	 * @param layer: index of the layer
+	 * @param channelPaths: path of the image file of every channel of the array
+	 */
+	void loadLayer(const TextureArray& array, GLint layer, const std::vector<std::string>& channelPaths);
+
+	/*!
+	 * Creates a 2D texture of a single placeholder texel and queues an image file for it
+	 * @param path: path of the image file
+	 * @param placeholder: color of the texture until the image is uploaded
+	 * @param compress: whether to block-compress the image, images with four channels stay uncompressed
+	 * @return the texture handle
+	 */
+	GLuint load2D(const std::string& path, glm::u8vec4 placeholder = glm::u8vec4(255), bool compress = false);
+
+	/*!
+	 * Uploads decoded images, call once per frame
+	 * Stops after the budget is used up, but always uploads at least one image
+	 * @param byteBudget: number of bytes to upload at most
+	 */
+	void update(size_t byteBudget = 32 << 20);
+
+	/*!
+	 * Waits until all queued images are decoded and uploaded
+	 */
+	void finish();
+
+	/*!
+	 * @return whether all queued images are uploaded
+	 */
+	bool idle() const;
+
+	/*!
+	 * Prints the timings of all textures, done automatically the first time the loader becomes idle
+	 */
+	void report(std::ostream& out) const;
+};
+
+TextureLoader::TextureLoader(unsigned int threads, const std::string& cacheDirectory)
+	: _stop(false), _pending(0), _cacheDirectory(cacheDirectory), _start(std::chrono::steady_clock::now()), _firstUpdate(-1.0), _reported(false)
+{
+	glGenBuffers(1, &_pbo);
+	_bc1Supported = BlockCompression::isSupported(TextureCompression::BC1);
+	if (!_cacheDirectory.empty())
+		makeDirectory(_cacheDirectory);
+
+	if (threads == 0)
+		threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	for (unsigned int i = 0; i < threads; i++)
+		_workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (std::thread& worker : _workers)
+		worker.join();
+
+	glState.deleteBuffer(_pbo);
+}
+
+double TextureLoader::now() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count();
+}
+
+void TextureLoader::workerLoop()
+{
+	while (true) {
+		std::unique_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _stop || !_queue.empty(); });
+			if (_stop) return;
+			job = std::move(_queue.front());
+			_queue.pop_front();
+		}
+
+		decode(*job);
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_done.push_back(std::move(job));
+		}
+		_decoded.notify_one();
+	}
+}
+
+std::string TextureLoader::sourceKey(const Job& job)
+{
+	return job.path + "|" + std::to_string(job.width) + "x" + std::to_string(job.height) + "x" + std::to_string(job.channels)
+		+ (job.compress ? "|compressed" : "");
+}
+
+void TextureLoader::enqueue(std::unique_ptr<Job> job)
+{
+	job->key = sourceKey(*job);
+	auto queued = _jobs.find(job->key);
+	if (queued != _jobs.end()) {
+		queued->second->targets.push_back(job->targets[0]);
+		_timings[queued->second->timing].targets++;
+		return;
+	}
+
+	TextureTiming timing = { job->path, now(), 0.0, 0.0, 0.0, 0.0, false, false, 0, 0, 1 };
+	job->timing = _timings.size();
+	_timings.push_back(timing);
+	_jobs[job->key] = job.get();
+	_pending++;
+	_reported = false;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(std::move(job));
+	}
+	_wake.notify_one();
+}
+
+void TextureLoader::loadLayer(const TextureArray& array, GLint layer, const std::string& path)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->path = path;
+	job->targets.push_back({ array.handle(), layer });
+	job->width = array.width();
+	job->height = array.height();
+	job->channels = array.channels();
+	job->compress = array.compression() != TextureCompression::NONE;
+	enqueue(std::move(job));
+}
+
+void TextureLoader::loadLayer(const TextureArray& array, GLint layer, const std::vector<std::string>& channelPaths)
+{
+	std::unique_ptr<Job> job(new Job());
+	for (const std::string& path : channelPaths)
+		job->path += (job->path.empty() ? "" : " + ") + path;
+	job->channelPaths = channelPaths;
+	job->targets.push_back({ array.handle(), layer });
+	job->width = array.width();
+	job->height = array.height();
+	job->channels = array.channels();
+	job->compress = array.compression() != TextureCompression::NONE;
+	enqueue(std::move(job));
+}
+
+GLuint TextureLoader::load2D(const std::string& path, glm::u8vec4 placeholder, bool compress)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glState.bindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glState.bindTexture(GL_TEXTURE_2D, 0);
+
+	std::unique_ptr<Job> job(new Job());
+	job->path = path;
+	job->targets.push_back({ texture, -1 });
+	job->width = 0;
+	job->height = 0;
+	job->channels = 0;
+	job->compress = compress;
+	enqueue(std::move(job));
+
+	return texture;
+}
+
+void TextureLoader::makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+std::string TextureLoader::cachePath(const Job& job) const
+{
+	// FNV-1a of the image files and everything that changes the chain built from them
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const char* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	std::vector<std::string> paths = job.channelPaths.empty() ? std::vector<std::string>(1, job.path) : job.channelPaths;
+	for (const std::string& path : paths) {
+		MappedFile file;
+		if (!file.open(path.c_str())) return "";
+		add(file.data(), file.size());
+	}
+
+	int settings[5] = { job.width, job.height, job.channels, (int)paths.size(), (int)CACHE_VERSION };
+	add((const char*)settings, sizeof(settings));
+
+	char name[21];
+	std::snprintf(name, sizeof(name), "%016llx.dds", (unsigned long long)hash);
+	return _cacheDirectory + "/" + name;
+}
+
+void TextureLoader::decode(Job& job) const
+{
+	job.decodeStart = now();
+	job.cached = false;
+	job.compression = TextureCompression::NONE;
+
+	// the header tells the channels of a file without decoding it, those with alpha stay uncompressed
+	if (job.compress && job.channels == 0) {
+		int width, height, channels;
+		if (stbi_info(job.path.c_str(), &width, &height, &channels) && (channels == 1 || channels == 3))
+			job.channels = channels;
+		else
+			job.compress = false;
+	}
+
+	std::string cache;
+	if (job.compress && !_cacheDirectory.empty() && job.channels != 4)
+		cache = cachePath(job);
+
+	DdsImage image;
+	if (!cache.empty() && DdsFile::read(cache, image) && image.compression == BlockCompression::forChannels(job.channels)
+		&& (job.width == 0 || image.width == job.width) && (job.height == 0 || image.height == job.height)) {
+		job.loaded = true;
+		job.cached = true;
+		job.compression = image.compression;
+		job.width = image.width;
+		job.height = image.height;
+		job.pixels = std::move(image.data);
+		job.levelOffsets = std::move(image.levelOffsets);
+		job.decodeEnd = now();
+		return;
+	}
+
+	int width = job.width, height = job.height, channels = job.channels;
+	std::vector<unsigned char> pixels;
+	if (job.channelPaths.empty())
+		job.loaded = TextureArray::loadImage(job.path.c_str(), channels, width, height, pixels);
+	else
+		job.loaded = TextureArray::loadPackedImage(job.channelPaths, width, height, pixels);
+	if (!job.loaded) {
+		job.decodeEnd = now();
+		return;
+	}
+
+	if (job.compress) {
+		job.compression = BlockCompression::forChannels(channels);
+		if (job.compression == TextureCompression::BC1 && !_bc1Supported)
+			job.compression = TextureCompression::NONE;
+	}
+
+	BlockCompression::buildLevels(pixels.data(), width, height, channels, job.compression, job.pixels, job.levelOffsets);
+
+	if (!cache.empty() && job.compression != TextureCompression::NONE) {
+		image.compression = job.compression;
+		image.width = width;
+		image.height = height;
+		image.data = job.pixels;
+		image.levelOffsets = job.levelOffsets;
+		if (!DdsFile::write(cache, image))
+			std::cout << "Texture cache not written at path: " << cache << std::endl;
+	}
+
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.decodeEnd = now();
+}
+
+void TextureLoader::upload(Job& job)
+{
+	// the job is done, a later request for the image starts a new one
+	_jobs.erase(job.key);
+
+	TextureTiming& timing = _timings[job.timing];
+	timing.decodeStart = job.decodeStart;
+	timing.decodeEnd = job.decodeEnd;
+	timing.loaded = job.loaded;
+	timing.cached = job.cached;
+	timing.uploadStart = now();
+
+	if (!job.loaded) {
+		std::cout << "Texture failed to load at path: " << job.path << std::endl;
+		timing.uploaded = now();
+		return;
+	}
+
+	// the copy into the buffer is the only work on the main thread, the driver transfers the buffer to the texture
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, job.pixels.size(), nullptr, GL_STREAM_DRAW);
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, job.pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped != nullptr) {
+		std::memcpy(mapped, job.pixels.data(), job.pixels.size());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else {
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, job.pixels.size(), job.pixels.data());
+	}
+
+	GLenum format = TextureArray::pixelFormat(job.channels);
+	GLenum compressedFormat = BlockCompression::internalFormat(job.compression);
+	bool compressed = job.compression != TextureCompression::NONE;
+	GLint levels = (GLint)job.levelOffsets.size();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// every texture that shares the image is filled from the same buffer
+	for (const Target& target : job.targets) {
+		if (target.layer >= 0) {
+			glState.bindTexture(GL_TEXTURE_2D_ARRAY, target.texture);
+			for (GLint level = 0; level < levels; level++) {
+				GLsizei width = std::max(1, job.width >> level), height = std::max(1, job.height >> level);
+				const void* offset = (const void*)job.levelOffsets[level];
+				if (compressed)
+					glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, target.layer, width, height, 1, compressedFormat,
+						(GLsizei)BlockCompression::compressedSize(job.compression, width, height), offset);
+				else
+					glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, target.layer, width, height, 1, format, GL_UNSIGNED_BYTE, offset);
+			}
+			glState.bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		}
+		else {
+			glState.bindTexture(GL_TEXTURE_2D, target.texture);
+			for (GLint level = 0; level < levels; level++) {
+				GLsizei width = std::max(1, job.width >> level), height = std::max(1, job.height >> level);
+				const void* offset = (const void*)job.levelOffsets[level];
+				if (compressed)
+					glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedFormat, width, height, 0,
+						(GLsizei)BlockCompression::compressedSize(job.compression, width, height), offset);
+				else
+					glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, offset);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			glState.bindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+
+	timing.bytes = job.pixels.size() * job.targets.size();
+	for (GLint level = 0; level < levels; level++)
+		timing.uncompressedBytes += (size_t)std::max(1, job.width >> level) * std::max(1, job.height >> level) * job.channels * job.targets.size();
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	timing.uploaded = now();
+}
+
+void TextureLoader::update(size_t byteBudget)
+{
+	if (_firstUpdate < 0.0)
+		_firstUpdate = now();
+
+	size_t uploaded = 0;
+	while (uploaded < byteBudget) {
+		std::unique_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_done.empty()) break;
+			job = std::move(_done.front());
+			_done.pop_front();
+		}
+
+		upload(*job);
+		uploaded += job->pixels.size();
+		_pending--;
+	}
+
+	if (_pending == 0 && !_reported && !_timings.empty()) {
+		_reported = true;
+		report(std::cout);
+	}
+}
+
+void TextureLoader::finish()
+{
+	while (_pending > 0) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_decoded.wait(lock, [&] { return !_done.empty(); });
+		}
+		update((size_t)-1);
+	}
+}
+
+bool TextureLoader::idle() const
+{
+	return _pending == 0;
+}
+
+void TextureLoader::report(std::ostream& out) const
+{
+	double decodeSum = 0.0, slowest = 0.0, ready = 0.0;
+	size_t cached = 0, bytes = 0, uncompressedBytes = 0;
+	for (const TextureTiming& timing : _timings) {
+		decodeSum += timing.decodeEnd - timing.decodeStart;
+		slowest = std::max(slowest, timing.decodeEnd - timing.decodeStart);
+		ready = std::max(ready, timing.uploaded);
+		cached += timing.cached ? 1 : 0;
+		bytes += timing.bytes;
+		uncompressedBytes += timing.uncompressedBytes;
+	}
+
+	std::ios::fmtflags flags = out.flags();
+	std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1);
+	out << "texture loading: " << _timings.size() << " images on " << _workers.size() << " threads, first frame after "
+		<< std::max(0.0, _firstUpdate) << " ms, all textures after " << ready << " ms" << std::endl;
+	out << "  sum of decodes " << decodeSum << " ms, slowest decode " << slowest << " ms, " << cached << " read from the cache" << std::endl;
+	out << "  video memory " << bytes / 1048576.0 << " MB, uncompressed " << uncompressedBytes / 1048576.0 << " MB" << std::endl;
+	out << "  waiting   decode   upload    ready  path" << std::endl;
+	for (const TextureTiming& timing : _timings) {
+		out << std::setw(9) << timing.decodeStart - timing.queued << std::setw(9) << timing.decodeEnd - timing.decodeStart
+			<< std::setw(9) << timing.uploaded - timing.uploadStart << std::setw(9) << timing.uploaded
+			<< "  " << timing.path << (timing.loaded ? "" : " (failed)") << (timing.cached ? " (cached)" : "")
+			<< (timing.targets > 1 ? " (" + std::to_string(timing.targets) + " textures)" : "") << std::endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
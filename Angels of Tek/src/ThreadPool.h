@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Fixed set of worker threads that split loops over an index range
+ */
+class ThreadPool
+{
+protected:
+	std::vector<std::thread> _workers;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+
+	/*!
+	 * Current job: the body and the range that is handed out in blocks
+	 */
+	std::function<void(size_t, size_t)> _job;
+	size_t _next, _end, _blockSize;
+
+	/*!
+	 * Number of workers still running the current job
+	 */
+	unsigned int _busy;
+
+	/*!
+	 * Incremented for every job, so workers can tell a new job from a spurious wake-up
+	 */
+	unsigned int _generation;
+	bool _stop;
+
+	void workerLoop();
+
+	/*!
+	 * Runs blocks of the current job until the range is exhausted
+	 */
+	void runBlocks();
+
+public:
+	/*!
+	 * Thread pool constructor
+	 * @param threads: number of worker threads, 0 uses one less than the number of hardware threads
+	 */
+	explicit ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/*!
+	 * Calls body(begin, end) for consecutive blocks of [0, count) on the workers and the calling thread
+	 * Returns once the whole range is done
+	 * @param count: size of the range
+	 * @param blockSize: number of indices handed out at once
+	 * @param body: function called for every block
+	 */
+	void parallelFor(size_t count, size_t blockSize, const std::function<void(size_t, size_t)>& body);
+
+	/*!
+	 * @return the number of threads that run a job, including the calling thread
+	 */
+	unsigned int threadCount() const;
+};
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: _next(0), _end(0), _blockSize(1), _busy(0), _generation(0), _stop(false)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+	for (unsigned int i = 0; i < threads; i++)
+		_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	for (std::thread& worker : _workers)
+		worker.join();
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned int generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _stop || _generation != generation; });
+			if (_stop) return;
+			generation = _generation;
+		}
+
+		runBlocks();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_busy == 0)
+			_done.notify_one();
+	}
+}
+
+void ThreadPool::runBlocks()
+{
+	while (true) {
+		size_t begin, end;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_next >= _end) return;
+			begin = _next;
+			end = std::min(_next + _blockSize, _end);
+			_next = end;
+		}
+		_job(begin, end);
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, size_t blockSize, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0) return;
+
+	// not worth waking the workers for a single block
+	if (_workers.empty() || count <= blockSize) {
+		body(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = body;
+		_next = 0;
+		_end = count;
+		_blockSize = std::max<size_t>(1, blockSize);
+		_busy = (unsigned int)_workers.size();
+		_generation++;
+	}
+	_wake.notify_all();
+
+	runBlocks();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [&] { return _busy == 0; });
+	_job = nullptr;
+}
+
+unsigned int ThreadPool::threadCount() const
+{
+	return (unsigned int)_workers.size() + 1;
+}
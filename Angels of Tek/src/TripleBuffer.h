@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+
+/*!
+ * Lock-free handoff of values from one producer thread to one consumer thread
+ *
+ * The producer writes into the back slot and publishes it by swapping it with the middle slot, the consumer
+ * takes the middle slot by swapping it with its front slot. Neither side ever waits for the other: the producer
+ * overwrites a value the consumer did not take yet, the consumer keeps reading its front slot until a newer one
+ * is published.
+ */
+template <typename T>
+class TripleBuffer
+{
+protected:
+	/*!
+	 * Set in _middle while the middle slot holds a value the consumer has not taken yet
+	 */
+	static const unsigned int FRESH = 4;
+
+	T _slots[3];
+
+	/*!
+	 * Index of the middle slot, owned by neither side, and the FRESH bit
+	 */
+	std::atomic<unsigned int> _middle;
+
+	/*!
+	 * Only used by the producer
+	 */
+	unsigned int _back;
+
+	/*!
+	 * Only used by the consumer
+	 */
+	unsigned int _front;
+
+public:
+	TripleBuffer();
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	/*!
+	 * @return the slot the producer writes the next value into, it keeps its old contents
+	 */
+	T& back();
+
+	/*!
+	 * Hands the back slot to the consumer, called by the producer
+	 */
+	void publish();
+
+	/*!
+	 * Takes the latest published value if there is one, called by the consumer
+	 * @return true if front() changed
+	 */
+	bool consume();
+
+	/*!
+	 * @return the value the consumer took last
+	 */
+	const T& front() const;
+};
+
+template <typename T>
+TripleBuffer<T>::TripleBuffer()
+	: _middle(1), _back(0), _front(2)
+{
+}
+
+template <typename T>
+T& TripleBuffer<T>::back()
+{
+	return _slots[_back];
+}
+
+template <typename T>
+void TripleBuffer<T>::publish()
+{
+	// release makes the writes to the slot visible to the consumer that acquires it
+	_back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+}
+
+template <typename T>
+bool TripleBuffer<T>::consume()
+{
+	if ((_middle.load(std::memory_order_relaxed) & FRESH) == 0)
+		return false;
+
+	_front = _middle.exchange(_front, std::memory_order_acq_rel) & ~FRESH;
+	return true;
+}
+
+template <typename T>
+const T& TripleBuffer<T>::front() const
+{
+	return _slots[_front];
+}
@@ -0,0 +1,94 @@
+/*
+* Converts a beatmap from the text format into the binary format read by the game
+*
+* Text format, one statement per line, everything after # is a comment:
+*   bpm <beats per minute>        has to come before the first note
+*   speed <units per second>      distance the runner moves per second, default Beatmap::DEFAULT_SPEED
+*   offset <seconds>              time of beat 0, default 0
+*   <beat> <lane> <type> [length] a note, lane goes from -2 to 2, length is in beats
+*
+* Usage: BeatmapConverter <input.txt> <output.aotb>
+*/
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Beatmap.h"
+
+static const int LANE_COUNT = 5;
+
+int main(int argc, char** argv)
+{
+	if (argc != 3) {
+		std::cout << "usage: BeatmapConverter <input.txt> <output.aotb>" << std::endl;
+		return 1;
+	}
+
+	std::ifstream input(argv[1]);
+	if (!input) {
+		std::cout << "ERROR::BEATMAP_CONVERTER::INPUT_NOT_FOUND " << argv[1] << std::endl;
+		return 1;
+	}
+
+	float bpm = 0.0f;
+	float speed = Beatmap::DEFAULT_SPEED;
+	float offset = 0.0f;
+	std::vector<BeatmapNote> notes;
+
+	std::string line;
+	for (int lineNumber = 1; std::getline(input, line); lineNumber++) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream statement(line);
+
+		std::string first;
+		if (!(statement >> first)) continue;
+
+		bool valid;
+		if (first == "bpm") {
+			valid = (bool)(statement >> bpm) && bpm > 0.0f;
+		}
+		else if (first == "speed") {
+			valid = (bool)(statement >> speed) && speed > 0.0f;
+		}
+		else if (first == "offset") {
+			valid = (bool)(statement >> offset);
+		}
+		else {
+			float beat = 0.0f, length = 0.0f;
+			int lane = 0, type = 0;
+			valid = bpm > 0.0f && (bool)(std::istringstream(first) >> beat) && (bool)(statement >> lane >> type)
+				&& lane >= -LANE_COUNT / 2 && lane <= LANE_COUNT / 2 && type >= 0 && type <= 255;
+			if (valid && !(statement >> length)) length = 0.0f;
+
+			if (valid) {
+				float secondsPerBeat = 60.0f / bpm;
+				BeatmapNote note = {};
+				note.time = offset + beat * secondsPerBeat;
+				note.length = length * secondsPerBeat;
+				note.lane = (uint8_t)(lane + LANE_COUNT / 2);
+				note.type = (uint8_t)type;
+				notes.push_back(note);
+			}
+		}
+
+		if (!valid) {
+			std::cout << "ERROR::BEATMAP_CONVERTER::INVALID_LINE " << argv[1] << ":" << lineNumber << ": " << line << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<char> image = Beatmap::encode(bpm, speed, LANE_COUNT, notes);
+
+	std::ofstream output(argv[2], std::ios::binary);
+	output.write(image.data(), image.size());
+	if (!output) {
+		std::cout << "ERROR::BEATMAP_CONVERTER::OUTPUT_NOT_WRITTEN " << argv[2] << std::endl;
+		return 1;
+	}
+
+	std::cout << "converted " << notes.size() << " notes to " << argv[2] << " (" << image.size() << " bytes)" << std::endl;
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+* Generates beatmaps from music: decodes every track, finds its onsets and places an obstacle on each
+*
+* The lane of an obstacle is the frequency band that changed the most, from bass on the left to treble
+* on the right, its type is the quartile of the onset strength. Results are cached by a hash of the audio
+* file, so every song is only analysed once, no matter under which name or how often it is generated.
+*
+* Usage: LevelGenerator [--out dir] [--cache dir] [--threshold t] [--force] <audio files...>
+*/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <irrKlang/irrKlang.h>
+
+#include "Beatmap.h"
+#include "MappedFile.h"
+#include "OnsetDetector.h"
+#include "ThreadPool.h"
+
+static const int LANE_COUNT = 5;
+
+/*!
+ * Changes whenever the analysis changes, so cached beatmaps of an older analysis are not used
+ */
+static const uint32_t ANALYSIS_VERSION = 2;
+
+struct Options {
+	std::string outDirectory = "assets/beatmaps";
+	std::string cacheDirectory = "assets/beatmaps/cache";
+	float threshold = 1.0f;
+	bool force = false;
+	std::vector<std::string> tracks;
+};
+
+static void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+/*!
+ * FNV-1a hash of the audio file and the analysis settings
+ */
+static uint64_t contentHash(const MappedFile& file, const Options& options)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto add = [&](const char* data, size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	add(file.data(), file.size());
+	add((const char*)&ANALYSIS_VERSION, sizeof(ANALYSIS_VERSION));
+	add((const char*)&options.threshold, sizeof(options.threshold));
+	return hash;
+}
+
+/*!
+ * File name without directory and extension
+ */
+static std::string trackName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static bool writeFile(const std::string& path, const char* data, size_t size)
+{
+	std::ofstream output(path, std::ios::binary);
+	output.write(data, size);
+	return (bool)output;
+}
+
+/*!
+ * Decodes a track into mono samples with irrKlang
+ * @return whether the track could be decoded
+ */
+static bool decode(irrklang::ISoundEngine* engine, const std::string& path, std::vector<float>& samples, int& sampleRate)
+{
+	irrklang::ISoundSource* source = engine->addSoundSourceFromFile(path.c_str(), irrklang::ESM_NO_STREAMING, true);
+	if (source == nullptr) return false;
+
+	irrklang::SAudioStreamFormat format = source->getAudioFormat();
+	const void* data = source->getSampleData();
+	if (data == nullptr || format.FrameCount <= 0 || format.ChannelCount <= 0) {
+		engine->removeSoundSource(source);
+		return false;
+	}
+
+	sampleRate = format.SampleRate;
+	samples.resize(format.FrameCount);
+	for (int frame = 0; frame < format.FrameCount; frame++) {
+		float sum = 0.0f;
+		for (int channel = 0; channel < format.ChannelCount; channel++) {
+			int i = frame * format.ChannelCount + channel;
+			if (format.SampleFormat == irrklang::ESF_U8)
+				sum += (((const unsigned char*)data)[i] - 128) / 128.0f;
+			else
+				sum += ((const int16_t*)data)[i] / 32768.0f;
+		}
+		samples[frame] = sum / format.ChannelCount;
+	}
+
+	// the decoded track is not needed anymore, only the mono copy
+	engine->removeSoundSource(source);
+	return true;
+}
+
+/*!
+ * Turns onsets into notes, one per onset
+ */
+static std::vector<BeatmapNote> notesFromOnsets(const std::vector<Onset>& onsets)
+{
+	// types by the quartile of the strength, so every track uses all four types
+	std::vector<float> strengths;
+	for (const Onset& onset : onsets)
+		strengths.push_back(onset.strength);
+	std::sort(strengths.begin(), strengths.end());
+
+	std::vector<BeatmapNote> notes;
+	for (const Onset& onset : onsets) {
+		size_t rank = std::lower_bound(strengths.begin(), strengths.end(), onset.strength) - strengths.begin();
+
+		BeatmapNote note = {};
+		note.time = onset.time;
+		note.lane = (uint8_t)(onset.band * LANE_COUNT / OnsetDetector::BAND_COUNT);
+		note.type = (uint8_t)(rank * 4 / strengths.size());
+		notes.push_back(note);
+	}
+	return notes;
+}
+
+/*!
+ * Generates the beatmap of a track, or copies it from the cache
+ * @return whether the beatmap was written
+ */
+static bool generate(const std::string& path, const Options& options, irrklang::ISoundEngine* engine, OnsetDetector& detector)
+{
+	MappedFile file;
+	if (!file.open(path.c_str())) {
+		std::cout << "ERROR::LEVEL_GENERATOR::TRACK_NOT_FOUND " << path << std::endl;
+		return false;
+	}
+
+	char hash[17];
+	std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)contentHash(file, options));
+	file.close();
+
+	std::string cachePath = options.cacheDirectory + "/" + hash + ".aotb";
+	std::string outPath = options.outDirectory + "/" + trackName(path) + ".aotb";
+
+	Beatmap cached;
+	if (!options.force && cached.open(cachePath.c_str())) {
+		MappedFile cachedFile;
+		cachedFile.open(cachePath.c_str());
+		if (!writeFile(outPath, cachedFile.data(), cachedFile.size())) {
+			std::cout << "ERROR::LEVEL_GENERATOR::OUTPUT_NOT_WRITTEN " << outPath << std::endl;
+			return false;
+		}
+		std::cout << path << ": cached " << hash << " -> " << outPath << std::endl;
+		return true;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<float> samples;
+	int sampleRate = 0;
+	if (!decode(engine, path, samples, sampleRate)) {
+		std::cout << "ERROR::LEVEL_GENERATOR::TRACK_NOT_DECODED " << path << std::endl;
+		return false;
+	}
+
+	auto decoded = std::chrono::steady_clock::now();
+	std::vector<Onset> onsets = detector.detect(samples, sampleRate);
+	float bpm = detector.estimateBpm();
+	std::vector<char> image = Beatmap::encode(bpm, Beatmap::DEFAULT_SPEED, LANE_COUNT, notesFromOnsets(onsets));
+	auto analysed = std::chrono::steady_clock::now();
+
+	if (!writeFile(cachePath, image.data(), image.size()))
+		std::cout << "ERROR::LEVEL_GENERATOR::CACHE_NOT_WRITTEN " << cachePath << std::endl;
+	if (!writeFile(outPath, image.data(), image.size())) {
+		std::cout << "ERROR::LEVEL_GENERATOR::OUTPUT_NOT_WRITTEN " << outPath << std::endl;
+		return false;
+	}
+
+	double seconds = (double)samples.size() / sampleRate;
+	double decodeMs = std::chrono::duration<double, std::milli>(decoded - start).count();
+	double analysisMs = std::chrono::duration<double, std::milli>(analysed - decoded).count();
+	std::cout << path << ": " << onsets.size() << " onsets, " << bpm << " bpm, " << seconds << " s of audio, decode " << decodeMs
+		<< " ms, analysis " << analysisMs << " ms (" << seconds * 1000.0 / (decodeMs + analysisMs) << "x realtime) -> " << outPath << std::endl;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--out" && i + 1 < argc) options.outDirectory = argv[++i];
+		else if (arg == "--cache" && i + 1 < argc) options.cacheDirectory = argv[++i];
+		else if (arg == "--threshold" && i + 1 < argc) options.threshold = (float)std::atof(argv[++i]);
+		else if (arg == "--force") options.force = true;
+		else options.tracks.push_back(arg);
+	}
+
+	if (options.tracks.empty()) {
+		std::cout << "usage: LevelGenerator [--out dir] [--cache dir] [--threshold t] [--force] <audio files...>" << std::endl;
+		return 1;
+	}
+
+	makeDirectory(options.outDirectory);
+	makeDirectory(options.cacheDirectory);
+
+	// the null driver decodes without opening an audio device
+	irrklang::ISoundEngine* engine = irrklang::createIrrKlangDevice(irrklang::ESOD_NULL);
+	if (engine == nullptr) {
+		std::cout << "ERROR::LEVEL_GENERATOR::IRRKLANG_NOT_STARTED" << std::endl;
+		return 1;
+	}
+
+	ThreadPool pool;
+	OnsetDetector detector(pool, options.threshold);
+
+	int failed = 0;
+	for (const std::string& track : options.tracks) {
+		if (!generate(track, options, engine, detector))
+			failed++;
+	}
+
+	engine->drop();
+	return failed == 0 ? 0 : 1;
+}
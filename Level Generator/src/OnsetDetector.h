@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*!
+ * A note onset found in the audio
+ */
+struct Onset {
+	/*!
+	 * Time of the onset in seconds
+	 */
+	float time;
+
+	/*!
+	 * Spectral flux at the onset in standard deviations above the mean flux of the track
+	 */
+	float strength;
+
+	/*!
+	 * Frequency band that changed the most, 0 is the lowest
+	 */
+	int band;
+};
+
+/*!
+ * Finds onsets with spectral flux: the track is cut into overlapping windowed frames, and the rise of the
+ * log magnitude spectrum from one frame to the next peaks where a note starts. Frames are independent
+ * apart from their predecessor, so blocks of frames are transformed in parallel on a thread pool.
+ */
+class OnsetDetector
+{
+protected:
+	ThreadPool& _pool;
+
+	/*!
+	 * Peaks have to rise this many standard deviations above the local mean of the flux
+	 */
+	float _threshold;
+
+	/*!
+	 * Minimum time between two onsets in seconds
+	 */
+	float _minInterval;
+
+	/*!
+	 * Tables of the FFT: Hann window, bit-reversed index and twiddle factor of every bin
+	 */
+	std::vector<float> _window;
+	std::vector<unsigned int> _bitReverse;
+	std::vector<std::complex<float>> _twiddles;
+
+	/*!
+	 * First bin of every band and one past the last bin of the last band
+	 */
+	std::vector<int> _bandStart;
+
+	/*!
+	 * Flux of every frame, in total and per band, kept from the last call of detect()
+	 * The flux of a band is the mean rise of its bins, the total is the sum over the bands
+	 */
+	std::vector<float> _flux;
+	std::vector<float> _bandFlux;
+	float _frameRate;
+
+	/*!
+	 * In-place radix-2 FFT of FRAME_SIZE samples
+	 */
+	void fft(std::complex<float>* data) const;
+
+	/*!
+	 * Log-compressed magnitude spectrum of the frame starting at a sample, samples past the end are zero
+	 */
+	void spectrum(const std::vector<float>& samples, size_t start, std::complex<float>* buffer, float* magnitudes) const;
+
+public:
+	static const int FRAME_SIZE = 1024;
+	static const int HOP_SIZE = 512;
+	static const int BAND_COUNT = 5;
+
+	/*!
+	 * Onset detector constructor
+	 * @param pool: the thread pool the frames are transformed on
+	 * @param threshold: standard deviations a peak has to rise above the local mean, lower finds more onsets
+	 * @param minInterval: minimum time between two onsets in seconds
+	 */
+	OnsetDetector(ThreadPool& pool, float threshold = 1.0f, float minInterval = 0.2f);
+
+	/*!
+	 * Finds the onsets of a track
+	 * @param samples: mono samples of the track
+	 * @param sampleRate: samples per second
+	 * @return the onsets ordered by time
+	 */
+	std::vector<Onset> detect(const std::vector<float>& samples, int sampleRate);
+
+	/*!
+	 * Estimates the tempo of the track passed to the last detect() from the autocorrelation of the flux
+	 * Only one octave is searched, otherwise a pattern repeating every two beats is taken for half the tempo
+	 * @return beats per minute between 80 and 160
+	 */
+	float estimateBpm() const;
+};
+
+OnsetDetector::OnsetDetector(ThreadPool& pool, float threshold, float minInterval)
+	: _pool(pool), _threshold(threshold), _minInterval(minInterval), _frameRate(0.0f)
+{
+	const float pi = 3.14159265358979f;
+
+	_window.resize(FRAME_SIZE);
+	for (int i = 0; i < FRAME_SIZE; i++)
+		_window[i] = 0.5f - 0.5f * std::cos(2.0f * pi * i / FRAME_SIZE);
+
+	int bits = 0;
+	while ((1 << bits) < FRAME_SIZE) bits++;
+	_bitReverse.resize(FRAME_SIZE);
+	for (unsigned int i = 0; i < FRAME_SIZE; i++) {
+		unsigned int reversed = 0;
+		for (int bit = 0; bit < bits; bit++)
+			reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+		_bitReverse[i] = reversed;
+	}
+
+	_twiddles.resize(FRAME_SIZE / 2);
+	for (int i = 0; i < FRAME_SIZE / 2; i++)
+		_twiddles[i] = std::polar(1.0f, -2.0f * pi * i / FRAME_SIZE);
+}
+
+void OnsetDetector::fft(std::complex<float>* data) const
+{
+	for (unsigned int i = 0; i < FRAME_SIZE; i++) {
+		if (i < _bitReverse[i])
+			std::swap(data[i], data[_bitReverse[i]]);
+	}
+
+	for (int size = 2; size <= FRAME_SIZE; size *= 2) {
+		int half = size / 2;
+		int step = FRAME_SIZE / size;
+		for (int start = 0; start < FRAME_SIZE; start += size) {
+			for (int i = 0; i < half; i++) {
+				std::complex<float> odd = data[start + i + half] * _twiddles[i * step];
+				data[start + i + half] = data[start + i] - odd;
+				data[start + i] += odd;
+			}
+		}
+	}
+}
+
+void OnsetDetector::spectrum(const std::vector<float>& samples, size_t start, std::complex<float>* buffer, float* magnitudes) const
+{
+	size_t available = start < samples.size() ? std::min<size_t>(FRAME_SIZE, samples.size() - start) : 0;
+	for (size_t i = 0; i < FRAME_SIZE; i++)
+		buffer[i] = i < available ? samples[start + i] * _window[i] : 0.0f;
+
+	fft(buffer);
+
+	// log compression evens out loud and quiet parts of the track
+	for (int bin = 0; bin <= FRAME_SIZE / 2; bin++)
+		magnitudes[bin] = std::log(1.0f + 10.0f * std::abs(buffer[bin]));
+}
+
+std::vector<Onset> OnsetDetector::detect(const std::vector<float>& samples, int sampleRate)
+{
+	const int bins = FRAME_SIZE / 2 + 1;
+	size_t frames = samples.size() / HOP_SIZE + 1;
+	_frameRate = (float)sampleRate / HOP_SIZE;
+
+	// bands with logarithmically spaced edges between 30 Hz and 16 kHz, one per lane
+	_bandStart.resize(BAND_COUNT + 1);
+	for (int band = 0; band <= BAND_COUNT; band++) {
+		float frequency = 30.0f * std::pow(16000.0f / 30.0f, (float)band / BAND_COUNT);
+		_bandStart[band] = std::min(bins, std::max(1, (int)(frequency * FRAME_SIZE / sampleRate)));
+	}
+	_bandStart[BAND_COUNT] = bins;
+
+	_flux.assign(frames, 0.0f);
+	_bandFlux.assign(frames * BAND_COUNT, 0.0f);
+
+	// every block also transforms the frame before its first, so blocks do not depend on each other
+	_pool.parallelFor(frames, 256, [&](size_t begin, size_t end) {
+		std::vector<std::complex<float>> buffer(FRAME_SIZE);
+		std::vector<float> previous(bins), current(bins);
+
+		if (begin > 0)
+			spectrum(samples, (begin - 1) * HOP_SIZE, buffer.data(), previous.data());
+		else
+			std::fill(previous.begin(), previous.end(), 0.0f);
+
+		for (size_t frame = begin; frame < end; frame++) {
+			spectrum(samples, frame * HOP_SIZE, buffer.data(), current.data());
+
+			// the flux of a band is averaged over its bins, otherwise the wide treble bands drown out the bass
+			float total = 0.0f;
+			for (int band = 0; band < BAND_COUNT; band++) {
+				float flux = 0.0f;
+				for (int bin = _bandStart[band]; bin < _bandStart[band + 1]; bin++)
+					flux += std::max(0.0f, current[bin] - previous[bin]);
+				flux /= (float)std::max(1, _bandStart[band + 1] - _bandStart[band]);
+				_bandFlux[frame * BAND_COUNT + band] = flux;
+				total += flux;
+			}
+			_flux[frame] = total;
+			std::swap(previous, current);
+		}
+	});
+
+	// the first frame rises from silence, that is not an onset
+	_flux[0] = 0.0f;
+
+	// normalize, so the threshold does not depend on the loudness of the track
+	double sum = 0.0, squares = 0.0;
+	for (float flux : _flux) {
+		sum += flux;
+		squares += (double)flux * flux;
+	}
+	float mean = (float)(sum / frames);
+	float deviation = (float)std::sqrt(std::max(0.0, squares / frames - (double)mean * mean));
+	if (deviation <= 0.0f) deviation = 1.0f;
+	for (float& flux : _flux)
+		flux = (flux - mean) / deviation;
+
+	// an onset is a local maximum that rises above the mean of its surroundings
+	const int maxWindow = 3;
+	const int meanBefore = 16, meanAfter = 4;
+	std::vector<Onset> onsets;
+	float lastTime = -1e30f;
+	for (size_t frame = 1; frame < frames; frame++) {
+		size_t first = frame > meanBefore ? frame - meanBefore : 0;
+		size_t last = std::min(frames - 1, frame + meanAfter);
+
+		bool isMax = true;
+		float local = 0.0f;
+		for (size_t i = first; i <= last; i++) {
+			local += _flux[i];
+			if (i + maxWindow >= frame && i <= frame + maxWindow && _flux[i] > _flux[frame])
+				isMax = false;
+		}
+		local /= (float)(last - first + 1);
+
+		// a frame starts at frame * HOP_SIZE, its window is centred half a frame later
+		float time = ((float)frame * HOP_SIZE + FRAME_SIZE / 2) / sampleRate;
+		if (!isMax || _flux[frame] < local + _threshold || time - lastTime < _minInterval) continue;
+
+		const float* bands = &_bandFlux[frame * BAND_COUNT];
+		Onset onset = { time, _flux[frame], (int)(std::max_element(bands, bands + BAND_COUNT) - bands) };
+		onsets.push_back(onset);
+		lastTime = time;
+	}
+
+	return onsets;
+}
+
+float OnsetDetector::estimateBpm() const
+{
+	if (_flux.empty()) return 120.0f;
+
+	int minLag = std::max(1, (int)(_frameRate * 60.0f / 160.0f));
+	int maxLag = (int)(_frameRate * 60.0f / 80.0f);
+
+	int bestLag = minLag;
+	double best = -1e30;
+	for (int lag = minLag; lag <= maxLag && lag < (int)_flux.size(); lag++) {
+		double correlation = 0.0;
+		for (size_t i = lag; i < _flux.size(); i++)
+			correlation += (double)std::max(0.0f, _flux[i]) * std::max(0.0f, _flux[i - lag]);
+		correlation /= (double)(_flux.size() - lag);
+		if (correlation > best) {
+			best = correlation;
+			bestLag = lag;
+		}
+	}
+
+	return 60.0f * _frameRate / bestLag;
+}
@@ -6,7 +6,7 @@ in VertexData {
     vec2 uv;
 } vert;
 
-uniform vec3 cameraWorldPosition;
+#include "perFrame.glsl"
 
 // material parameters
 uniform sampler2D albedoMap;
@@ -15,10 +15,6 @@ uniform sampler2D metallicMap;
 uniform sampler2D roughnessMap;
 uniform sampler2D aoMap;
 
-// lights
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
-
 out vec4 FragColor;
 
 const float PI = 3.14159265359;
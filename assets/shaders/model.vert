@@ -3,8 +3,10 @@ layout (location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv;
 
+#include "perFrame.glsl"
+#include "vertexQuantization.glsl"
+
 uniform mat4 modelMatrix;
-uniform mat4 viewProjMatrix;
 uniform mat3 normalMatrix;
 
 out VertexData {
@@ -15,9 +17,10 @@ out VertexData {
 
 void main() {
 	vert.uv = uv;
-	vert.normal_world = normalMatrix * normal;
+	vert.normal_world = normalMatrix * decodeNormal(normal);
 	// wie wach is das eig
-	vert.position_world = vec4(modelMatrix * vec4(position, 1)).xyz;
+	vec3 localPosition = decodePosition(position);
+	vert.position_world = vec4(modelMatrix * vec4(localPosition, 1)).xyz;
 
-	gl_Position = viewProjMatrix * modelMatrix * vec4(position, 1.0);
+	gl_Position = viewProjMatrix * modelMatrix * vec4(localPosition, 1.0);
 }
\ No newline at end of file
@@ -6,22 +6,20 @@ in VertexData {
     vec3 position_world;
     vec3 normal_world;
     vec2 uv;
+    flat int materialIndex;
 } vert;
 
-uniform vec3 cameraWorldPosition;
+#include "perFrame.glsl"
 
-// material parameters
+// material parameters, ormMap packs occlusion, roughness and metallic into r, g and b
 uniform sampler2D albedoMap;
 uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
-uniform sampler2D aoMap;
+uniform sampler2D ormMap;
 
-// lights
-uniform vec3 lightPositions[11];
-uniform vec3 lightColors[11];
-
-uniform float prightness;
+// material palette, one layer per material, see MaterialPalette.h
+uniform sampler2DArray albedoArray;
+uniform sampler2DArray normalArray;
+uniform sampler2DArray ormArray;
 
 out vec4 FragColor;
 
@@ -62,9 +60,28 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
     return ggx1 * ggx2;
 }
 
+// the material index is the same for a whole draw, so the branch does not diverge
+bool usePalette()
+{
+    return vert.materialIndex >= 0;
+}
+
+vec3 paletteCoord()
+{
+    return vec3(vert.uv, vert.materialIndex);
+}
+
 vec3 getNormalFromMap()
 {
-    vec3 tangentNormal = texture(normalMap, vert.uv).xyz * 2.0 - 1.0;
+    vec3 tangentNormal;
+    if (usePalette())
+    {
+        // the palette stores x and y only (BC5), z follows from the unit length
+        tangentNormal.xy = texture(normalArray, paletteCoord()).rg * 2.0 - 1.0;
+        tangentNormal.z = sqrt(max(0.0, 1.0 - dot(tangentNormal.xy, tangentNormal.xy)));
+    }
+    else
+        tangentNormal = texture(normalMap, vert.uv).xyz * 2.0 - 1.0;
 
     vec3 Q1  = dFdx(vert.position_world);
     vec3 Q2  = dFdy(vert.position_world);
@@ -86,10 +103,18 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
 
 void main()
 {		
-    vec3 albedo     = pow(texture(albedoMap, vert.uv).rgb, vec3(2.2));
-    float metallic  = texture(metallicMap, vert.uv).r;
-    float roughness = texture(roughnessMap, vert.uv).r;
-    float ao        = texture(aoMap, vert.uv).r;
+    vec3 albedo, orm;
+    if (usePalette()) {
+        albedo = texture(albedoArray, paletteCoord()).rgb;
+        orm    = texture(ormArray, paletteCoord()).rgb;
+    } else {
+        albedo = texture(albedoMap, vert.uv).rgb;
+        orm    = texture(ormMap, vert.uv).rgb;
+    }
+    albedo = pow(albedo, vec3(2.2));
+    float ao        = orm.r;
+    float roughness = orm.g;
+    float metallic  = orm.b;
 
     vec3 N = getNormalFromMap();
     vec3 V = normalize(cameraWorldPosition - vert.position_world);
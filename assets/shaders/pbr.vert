@@ -3,21 +3,28 @@ layout (location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 uv;
 
+#include "perFrame.glsl"
+#include "vertexQuantization.glsl"
+
 uniform mat4 modelMatrix;
-uniform mat4 viewProjMatrix;
 uniform mat3 normalMatrix;
+// index into the material palette, -1 samples the sampler2D maps (model meshes)
+uniform int materialIndex = -1;
 
 out VertexData {
 	vec3 position_world;
 	vec3 normal_world;
 	vec2 uv;
+	flat int materialIndex;
 } vert;
 
 void main() {
 	vert.uv = uv;
-	vert.normal_world = normalMatrix * normal;
+	vert.materialIndex = materialIndex;
+	vert.normal_world = normalMatrix * decodeNormal(normal);
 	// wie wach is das eig
-	vert.position_world = vec4(modelMatrix * vec4(position, 1)).xyz;
+	vec3 localPosition = decodePosition(position);
+	vert.position_world = vec4(modelMatrix * vec4(localPosition, 1)).xyz;
 
-	gl_Position = viewProjMatrix * modelMatrix * vec4(position, 1.0);
+	gl_Position = viewProjMatrix * modelMatrix * vec4(localPosition, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+#version 430
+layout (location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+// index of the draw within the multi draw, see ModelBatch.h
+layout(location = 8) in uint drawId;
+
+#include "perFrame.glsl"
+#include "vertexQuantization.glsl"
+
+// layout must match ModelDrawData in ModelBatch.h
+struct ModelDraw {
+	mat4 modelMatrix;
+	vec4 positionOffset;
+	vec4 positionScale;
+	int materialIndex;
+};
+
+layout(std430, binding = 1) readonly buffer ModelDraws {
+	ModelDraw draws[];
+};
+
+out VertexData {
+	vec3 position_world;
+	vec3 normal_world;
+	vec2 uv;
+	flat int materialIndex;
+} vert;
+
+void main() {
+	ModelDraw draw = draws[drawId];
+	mat3 normalMatrix = transpose(inverse(mat3(draw.modelMatrix)));
+
+	vert.uv = uv;
+	vert.materialIndex = draw.materialIndex;
+	vert.normal_world = normalMatrix * decodeNormal(normal);
+	vec3 localPosition = draw.positionOffset.xyz + position * draw.positionScale.xyz;
+	vert.position_world = vec4(draw.modelMatrix * vec4(localPosition, 1)).xyz;
+
+	gl_Position = viewProjMatrix * vec4(vert.position_world, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#version 430
+layout (location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+// per-instance attributes, see InstancedGeometry.h
+layout(location = 3) in mat4 instanceModelMatrix;
+layout(location = 7) in uint instanceMaterialIndex;
+
+#include "perFrame.glsl"
+
+out VertexData {
+	vec3 position_world;
+	vec3 normal_world;
+	vec2 uv;
+	flat int materialIndex;
+} vert;
+
+void main() {
+	mat3 normalMatrix = transpose(inverse(mat3(instanceModelMatrix)));
+
+	vert.uv = uv;
+	vert.materialIndex = int(instanceMaterialIndex);
+	vert.normal_world = normalMatrix * normal;
+	vert.position_world = vec4(instanceModelMatrix * vec4(position, 1)).xyz;
+
+	gl_Position = viewProjMatrix * vec4(vert.position_world, 1.0);
+}
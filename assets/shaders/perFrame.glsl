@@ -0,0 +1,25 @@
+// per-frame state shared by all programs, filled once per frame by PerFrameUniforms
+// the layout must match PerFrameData in PerFrameUniforms.h
+
+struct DirectionalLight {
+	vec3 color;
+	vec3 direction;
+};
+
+struct PointLight {
+	vec3 color;
+	vec3 position;
+	vec3 attenuation; // x = constant, y = linear, z = quadratic
+};
+
+layout(std140, binding = 0) uniform PerFrame {
+	mat4 viewProjMatrix;
+	vec3 cameraWorldPosition;
+	float prightness;
+	vec3 sky_color;
+	float u_time;
+	vec3 lightPositions[4];
+	vec3 lightColors[4];
+	DirectionalLight dirL;
+	PointLight pointL;
+};
@@ -13,23 +13,12 @@ in VertexData {
 
 out vec4 color;
 
-uniform vec3 camera_world;
+#include "perFrame.glsl"
 
 uniform vec3 materialCoefficients; // x = ambient, y = diffuse, z = specular 
 uniform float specularAlpha;
 uniform vec3 diffuseColor;
 
-uniform struct DirectionalLight {
-	vec3 color;
-	vec3 direction;
-} dirL;
-
-uniform struct PointLight {
-	vec3 color;
-	vec3 position;
-	vec3 attenuation;
-} pointL;
-
 vec3 phong(vec3 n, vec3 l, vec3 v, vec3 diffuseC, float diffuseF, vec3 specularC, float specularF, float alpha, bool attenuate, vec3 attenuation) {
 	float d = length(l);
 	l = normalize(l);
@@ -41,7 +30,7 @@ vec3 phong(vec3 n, vec3 l, vec3 v, vec3 diffuseC, float diffuseF, vec3 specularC
 
 void main() {	
 	vec3 n = normalize(vert.normal_world);
-	vec3 v = normalize(camera_world - vert.position_world);
+	vec3 v = normalize(cameraWorldPosition - vert.position_world);
 	
 	color = vec4(diffuseColor * materialCoefficients.x, 1); // ambient
 	
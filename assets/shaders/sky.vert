@@ -0,0 +1,8 @@
+#version 430
+
+// fullscreen triangle at the far plane, see FullscreenTriangle.h
+// the corners (-1, -1), (3, -1) and (-1, 3) cover the whole screen, z = w puts every pixel at depth 1
+void main() {
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 1.0, 1.0);
+}
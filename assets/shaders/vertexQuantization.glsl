@@ -0,0 +1,26 @@
+// decoding of QuantizedVertex (Mesh.h), set per mesh by Mesh::Draw
+// with the defaults the full float vertices of all other geometry pass through unchanged
+
+uniform bool quantizedVertex = false;
+// the positions are in [0, 1] within the bounds of the mesh
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+
+vec3 decodePosition(vec3 position)
+{
+	return positionOffset + position * positionScale;
+}
+
+// inverse of octahedralEncode() in Mesh.h
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
+vec3 decodeNormal(vec3 normal)
+{
+	return quantizedVertex ? octahedralDecode(normal.xy) : normal;
+}